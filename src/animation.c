@@ -0,0 +1,98 @@
+/*
+ * animation.c
+ *
+ * Scrolling animations on the LED matrix - see animation.h.
+ *
+ * Each frame is a shift and a copy of one column from flash, so no
+ * colours are worked out while an animation runs.
+ */
+
+#include "animation.h"
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include "ledmatrix.h"
+#include "timer0.h"
+
+// Copy of the descriptor of the running animation
+static Animation current;
+static uint8_t running;
+
+// Column of the strip to draw next, and frames left to hold for
+static uint8_t next_column;
+static uint8_t frames_to_hold;
+
+static uint32_t last_frame_time;
+
+static void draw_column(uint8_t x, uint8_t column)
+{
+	PaletteMatrixColumn column_data;
+	memcpy_P(column_data, &current.columns[column], sizeof(column_data));
+	ledmatrix_update_column_palette(x, column_data);
+}
+
+void animation_start(const Animation* animation)
+{
+	memcpy_P(&current, animation, sizeof(current));
+	
+	ledmatrix_begin_batch();
+	for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++)
+	{
+		draw_column(x, x % current.length);
+	}
+	ledmatrix_end_batch();
+	
+	next_column = MATRIX_NUM_COLUMNS % current.length;
+	frames_to_hold = current.start_hold_frames;
+	last_frame_time = get_current_time();
+	running = 1;
+}
+
+void animation_stop(void)
+{
+	running = 0;
+}
+
+uint8_t animation_running(void)
+{
+	return running;
+}
+
+void animation_service(void)
+{
+	if (!running)
+	{
+		return;
+	}
+	uint32_t current_time = get_current_time();
+	if (current_time - last_frame_time < current.frame_period)
+	{
+		return;
+	}
+	last_frame_time = current_time;
+	
+	if (frames_to_hold > 0)
+	{
+		frames_to_hold--;
+		return;
+	}
+	
+	ledmatrix_shift_display_left();
+	draw_column(MATRIX_NUM_COLUMNS - 1, next_column);
+	if (++next_column == current.length)
+	{
+		next_column = 0;
+	}
+	
+	// Back at the first screen?
+	if (next_column == MATRIX_NUM_COLUMNS % current.length)
+	{
+		if (current.loop)
+		{
+			frames_to_hold = current.hold_frames;
+		}
+		else
+		{
+			running = 0;
+		}
+	}
+}
@@ -0,0 +1,48 @@
+/*
+ * animation.h
+ *
+ * Scrolling animations on the LED matrix.
+ *
+ * An animation is a strip of columns kept in flash, each column packed as
+ * palette indices (see PaletteMatrixColumn in ledmatrix.h). When the
+ * animation starts the first MATRIX_NUM_COLUMNS columns are drawn. Each
+ * frame after that the display is shifted left and the next column of the
+ * strip is drawn in the rightmost column. The strip wraps around, so after
+ * length frames the first screen is showing again - a looping animation
+ * then holds for hold_frames frames and scrolls through again, any other
+ * animation stops.
+ */
+
+#ifndef ANIMATION_H_
+#define ANIMATION_H_
+
+#include <stdint.h>
+#include "ledmatrix.h"
+
+// Animation descriptor. Descriptors (and the columns they point to) must
+// be in flash (PROGMEM).
+typedef struct
+{
+	const PaletteMatrixColumn* columns;	// length columns
+	uint8_t length;				// at least 1
+	uint8_t frame_period;		// time between frames (ms)
+	uint8_t start_hold_frames;	// frames to show the first screen for
+	uint8_t hold_frames;		// frames to show it for on each loop
+	uint8_t loop;				// non-zero to loop forever
+} Animation;
+
+// Draw the first screen of an animation and start it running. Any
+// animation already running is replaced.
+void animation_start(const Animation* animation);
+
+// Stop the current animation, leaving the display as it is
+void animation_stop(void);
+
+// Returns non-zero if an animation is running
+uint8_t animation_running(void);
+
+// Draw the next frame of the current animation if it is due. Call this
+// regularly (at least once per frame period) from the main loop.
+void animation_service(void);
+
+#endif /* ANIMATION_H_ */
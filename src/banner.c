@@ -0,0 +1,127 @@
+/*
+ * banner.c
+ *
+ * Start screen banner, streamed to the terminal - see banner.h.
+ */
+
+#include "banner.h"
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include "terminalio.h"
+#include "serialio.h"
+#include "fmt.h"
+
+#define BANNER_NUM_LINES 9
+
+static const char banner_line_0[] PROGMEM =
+		" _______    ______  ________  ________  __        ________   ______   __    __  ______  _______  ";
+static const char banner_line_1[] PROGMEM =
+		"|       \\  /      \\|        \\|        \\|  \\      |        \\ /      \\ |  \\  |  \\|      \\|       \\ ";
+static const char banner_line_2[] PROGMEM =
+		"| $$$$$$$\\|  $$$$$$\\\\$$$$$$$$ \\$$$$$$$$| $$      | $$$$$$$$|  $$$$$$\\| $$  | $$ \\$$$$$$| $$$$$$$\\";
+static const char banner_line_3[] PROGMEM =
+		"| $$__/ $$| $$__| $$  | $$      | $$   | $$      | $$__    | $$___\\$$| $$__| $$  | $$  | $$__/ $$";
+static const char banner_line_4[] PROGMEM =
+		"| $$    $$| $$    $$  | $$      | $$   | $$      | $$  \\    \\$$    \\ | $$    $$  | $$  | $$    $$";
+static const char banner_line_5[] PROGMEM =
+		"| $$$$$$$\\| $$$$$$$$  | $$      | $$   | $$      | $$$$$    _\\$$$$$$\\| $$$$$$$$  | $$  | $$$$$$$ ";
+static const char banner_line_6[] PROGMEM =
+		"| $$__/ $$| $$  | $$  | $$      | $$   | $$_____ | $$_____ |  \\__| $$| $$  | $$ _| $$_ | $$      ";
+static const char banner_line_7[] PROGMEM =
+		"| $$    $$| $$  | $$  | $$      | $$   | $$     \\| $$     \\ \\$$    $$| $$  | $$|   $$ \\| $$      ";
+static const char banner_line_8[] PROGMEM =
+		" \\$$$$$$$  \\$$   \\$$   \\$$       \\$$    \\$$$$$$$$ \\$$$$$$$$  \\$$$$$$  \\$$   \\$$ \\$$$$$$ \\$$      ";
+
+static const char* const banner_lines[BANNER_NUM_LINES] PROGMEM =
+{
+	banner_line_0,
+	banner_line_1,
+	banner_line_2,
+	banner_line_3,
+	banner_line_4,
+	banner_line_5,
+	banner_line_6,
+	banner_line_7,
+	banner_line_8
+};
+
+// Runs of at least this many spaces are skipped with ESC[nC, and runs of
+// at least this many of another character are sent as the character and
+// ESC[nb (REP), which are shorter than sending the run
+#define MIN_SKIP_RUN 5
+#define MIN_REPEAT_RUN 6
+
+// Longest piece sent at once - a cursor movement (up to 9 bytes) and
+// ESC[nC or a character and ESC[nb (up to 6 bytes)
+#define MAX_PIECE_LENGTH (9 + 6)
+
+// Next line and character of the banner to send (line is
+// BANNER_NUM_LINES when it has all been sent)
+static uint8_t line = BANNER_NUM_LINES;
+static uint8_t position;
+
+void banner_start(void)
+{
+	line = 0;
+	position = 0;
+}
+
+uint8_t banner_done(void)
+{
+	return line == BANNER_NUM_LINES;
+}
+
+void banner_service(void)
+{
+	while (line < BANNER_NUM_LINES)
+	{
+		const char* text = pgm_read_ptr(&banner_lines[line]);
+		char c = pgm_read_byte(&text[position]);
+		if (c == '\0')
+		{
+			line++;
+			position = 0;
+			continue;
+		}
+		
+		// Find the run of characters the same as c
+		uint8_t run = 1;
+		while (pgm_read_byte(&text[position + run]) == c)
+		{
+			run++;
+		}
+		if (c == ' ' && pgm_read_byte(&text[position + run]) == '\0')
+		{
+			// Spaces at the end of a line - nothing to send
+			position += run;
+			continue;
+		}
+		
+		// Send one piece, unless that would mean waiting. Other output
+		// may have come between pieces, so we always say where the piece
+		// goes (which costs nothing if the cursor is already there).
+		if (serial_output_space() < MAX_PIECE_LENGTH)
+		{
+			return;
+		}
+		move_terminal_cursor(BANNER_X + position, BANNER_Y + line);
+		if (c == ' ' && run >= MIN_SKIP_RUN)
+		{
+			fmt_csi(run, 'C');
+		}
+		else if (BANNER_USE_REP && run >= MIN_REPEAT_RUN)
+		{
+			serial_put_char(c);
+			fmt_csi(run - 1, 'b');
+		}
+		else
+		{
+			if (run >= MIN_REPEAT_RUN)
+			{
+				run = MIN_REPEAT_RUN - 1;
+			}
+			serial_write_P(&text[position], run);
+		}
+		position += run;
+	}
+}
@@ -0,0 +1,35 @@
+/*
+ * banner.h
+ *
+ * The large banner on the start screen. Rather than being sent all at
+ * once (about 900 characters, which at 19200 baud would hold up the start
+ * screen for half a second), it is streamed out a piece at a time by
+ * banner_service(), which only sends what fits in the serial output
+ * buffer without waiting. Runs of spaces are skipped over with cursor
+ * movements, and (if BANNER_USE_REP is 1) other runs of the same
+ * character are sent with the REP escape sequence (ESC[nb), which some
+ * terminals don't support.
+ */
+
+#ifndef BANNER_H_
+#define BANNER_H_
+
+#include <stdint.h>
+
+#ifndef BANNER_USE_REP
+#define BANNER_USE_REP 1
+#endif
+
+// Terminal position of the top left of the banner
+#define BANNER_X 10
+#define BANNER_Y 4
+
+// Start sending the banner (after the terminal has been cleared)
+void banner_start(void);
+
+// Send as much more of the banner as can be sent without waiting. Call
+// this regularly until banner_done() returns 1.
+void banner_service(void);
+uint8_t banner_done(void);
+
+#endif /* BANNER_H_ */
@@ -0,0 +1,52 @@
+/*
+ * battle_log.c
+ *
+ * Scrolling battle log on the terminal - see battle_log.h.
+ */
+
+#include "battle_log.h"
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include "terminalio.h"
+#include "serialio.h"
+#include "fmt.h"
+
+void battle_log_init(void)
+{
+	set_scroll_region(BATTLE_LOG_TOP, BATTLE_LOG_BOTTOM);
+	move_terminal_cursor(1, BATTLE_LOG_HEADING);
+	fmt_string_P(PSTR("Battle log"));
+}
+
+// Start a new line at the bottom of the log, scrolling the older lines up
+static void new_line(uint8_t turn)
+{
+	move_terminal_cursor(1, BATTLE_LOG_BOTTOM);
+	scroll_up();
+	fmt_string_P(turn ? PSTR("Computer: ") : PSTR("Human:    "));
+}
+
+void battle_log_shot(uint8_t turn, uint8_t x, uint8_t y, uint8_t hit)
+{
+	new_line(turn);
+	serial_put_char('A' + x);
+	serial_put_char('1' + y);
+	fmt_string_P(hit ? PSTR(" hit") : PSTR(" miss"));
+}
+
+void battle_log_sunk(uint8_t turn, const char* ship_name)
+{
+	new_line(turn);
+	fmt_string_P(PSTR("sank the "));
+	fmt_string(ship_name);
+}
+
+void battle_log_salvo(uint8_t turn, uint8_t shots, uint8_t hits)
+{
+	new_line(turn);
+	fmt_string_P(PSTR("salvo of "));
+	fmt_u8(shots);
+	fmt_string_P(PSTR(", "));
+	fmt_u8(hits);
+	fmt_string_P(hits == 1 ? PSTR(" hit") : PSTR(" hits"));
+}
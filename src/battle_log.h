@@ -0,0 +1,33 @@
+/*
+ * battle_log.h
+ *
+ * A scrolling log of the game (shots, sunk ships and salvo summaries)
+ * on the terminal, below the status rows. The log rows are a terminal
+ * scroll region: a new line scrolls the region up by one row and only the
+ * new line is sent - the older lines are never sent again. The terminal
+ * needs at least BATTLE_LOG_BOTTOM rows.
+ *
+ * Cells are named by column letter (A-H, x = 0-7) and row number (1-8,
+ * y = 0-7).
+ */
+
+#ifndef BATTLE_LOG_H_
+#define BATTLE_LOG_H_
+
+#include <stdint.h>
+
+// Heading row, and the first and last rows of the log
+#define BATTLE_LOG_HEADING 22
+#define BATTLE_LOG_TOP 23
+#define BATTLE_LOG_BOTTOM 34
+
+// Show the heading and set up the scroll region (after the terminal has
+// been cleared)
+void battle_log_init(void);
+
+// turn is 0 for the human, 1 for the computer
+void battle_log_shot(uint8_t turn, uint8_t x, uint8_t y, uint8_t hit);
+void battle_log_sunk(uint8_t turn, const char* ship_name);
+void battle_log_salvo(uint8_t turn, uint8_t shots, uint8_t hits);
+
+#endif /* BATTLE_LOG_H_ */
@@ -0,0 +1,205 @@
+/*
+ * board_view.c
+ *
+ * Game boards on the terminal - see board_view.h.
+ */
+
+#include "board_view.h"
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include "terminalio.h"
+#include "serialio.h"
+#include "ledmatrix.h"
+#include "fmt.h"
+#include "game.h"
+
+#if BOARD_VIEW_HUMAN_X <= STATUS_COLUMNS
+#error "The board view would overlap the status rows"
+#endif
+
+#define HUMAN 0
+#define COMPUTER 1
+
+// Character and colour of each view (a colour of 0 is the terminal's
+// own, so the common case needs no escape sequence)
+typedef struct
+{
+	char glyph;
+	uint8_t colour;
+} ViewStyle;
+
+static const ViewStyle view_styles[NUM_VIEWS] PROGMEM =
+{
+	[VIEW_SEA] = {'.', 0},
+	[VIEW_SHIP] = {'O', FG_YELLOW},
+	[VIEW_PENDING] = {'+', FG_CYAN},
+	[VIEW_MISS] = {'o', FG_WHITE},
+	[VIEW_HIT] = {'X', FG_RED},
+	[VIEW_SUNK] = {'#', FG_MAGENTA},
+	[VIEW_PLACING] = {'S', FG_GREEN},
+	[VIEW_BLOCKED] = {'S', FG_RED}
+};
+
+// Display attributes in use - a foreground colour (or 0), with
+// ATTR_REVERSE added for reverse video
+#define ATTR_REVERSE 0x80
+static uint8_t attribute;
+
+// What each cell is showing (0xFF if not known), and the cells still to
+// be checked (bit x of pending[grid][y] for the cell at (x, y))
+static uint8_t shown[2][GRID_NUM_ROWS][GRID_NUM_COLUMNS];
+static uint8_t pending[2][GRID_NUM_ROWS];
+
+// Most bytes sent for one cell (cursor movement, display attributes and
+// the cell), and for putting the display attributes back afterwards
+#define CELL_COST 20
+#define RESET_COST 4
+
+// Terminal column just after the last cell sent this frame, and its row
+// (0 if nothing has been sent yet)
+static uint8_t next_x, next_y;
+
+// Terminal position of a cell
+static uint8_t cell_column(uint8_t grid, uint8_t x)
+{
+	return (grid == HUMAN ? BOARD_VIEW_HUMAN_X : BOARD_VIEW_COMPUTER_X)
+			+ 2 + 2 * x;
+}
+
+static uint8_t cell_row(uint8_t y)
+{
+	return BOARD_VIEW_TOP + 2 + (GRID_NUM_ROWS - 1 - y);
+}
+
+static void draw_frame(uint8_t grid)
+{
+	uint8_t column = cell_column(grid, 0);
+	move_terminal_cursor(column, BOARD_VIEW_TOP);
+	fmt_string_P(grid == HUMAN ? PSTR("Human") : PSTR("Computer"));
+	move_terminal_cursor(column, BOARD_VIEW_TOP + 1);
+	fmt_string_P(PSTR("A B C D E F G H"));
+	for (uint8_t y = 0; y < GRID_NUM_ROWS; y++)
+	{
+		move_terminal_cursor(column - 2, cell_row(y));
+		serial_put_char('1' + y);
+	}
+}
+
+void board_view_init(void)
+{
+	draw_frame(HUMAN);
+	draw_frame(COMPUTER);
+	for (uint8_t grid = HUMAN; grid <= COMPUTER; grid++)
+	{
+		for (uint8_t y = 0; y < GRID_NUM_ROWS; y++)
+		{
+			for (uint8_t x = 0; x < GRID_NUM_COLUMNS; x++)
+			{
+				shown[grid][y][x] = 0xFF;
+			}
+			pending[grid][y] = 0xFF;
+		}
+	}
+	attribute = 0;
+}
+
+static void set_attribute(uint8_t new_attribute)
+{
+	if (new_attribute == attribute)
+	{
+		return;
+	}
+	uint8_t colour = new_attribute & ~ATTR_REVERSE;
+	if (((attribute & ATTR_REVERSE) && !(new_attribute & ATTR_REVERSE))
+		|| (colour == 0 && (attribute & ~ATTR_REVERSE)))
+	{
+		// Only a reset turns these off
+		normal_display_mode();
+		attribute = 0;
+	}
+	if (new_attribute & ATTR_REVERSE)
+	{
+		if (colour)
+		{
+			fmt_csi2(TERM_REVERSE, colour, 'm');
+		}
+		else if (!(attribute & ATTR_REVERSE))
+		{
+			fmt_csi(TERM_REVERSE, 'm');
+		}
+	}
+	else if (colour)
+	{
+		fmt_csi(colour, 'm');
+	}
+	attribute = new_attribute;
+}
+
+static void send_cell(uint8_t grid, uint8_t x, uint8_t y, uint8_t view)
+{
+	uint8_t column = cell_column(grid, x);
+	uint8_t row = cell_row(y);
+	if (row == next_y && column == next_x + 1 && !(attribute & ATTR_REVERSE))
+	{
+		// Writing the gap from the last cell is shorter than moving over it
+		serial_put_char(' ');
+	}
+	else if (row != next_y || column != next_x)
+	{
+		move_terminal_cursor(column, row);
+	}
+	ViewStyle style;
+	memcpy_P(&style, &view_styles[view & ~VIEW_CURSOR], sizeof(style));
+	set_attribute(style.colour | ((view & VIEW_CURSOR) ? ATTR_REVERSE : 0));
+	serial_put_char(style.glyph);
+	next_x = column + 1;
+	next_y = row;
+}
+
+// Send changed cells until there is no more room
+static void send_pending(void)
+{
+	for (uint8_t grid = HUMAN; grid <= COMPUTER; grid++)
+	{
+		for (uint8_t y = 0; y < GRID_NUM_ROWS; y++)
+		{
+			for (uint8_t x = 0; pending[grid][y] && x < GRID_NUM_COLUMNS; x++)
+			{
+				uint8_t mask = 1 << x;
+				if (!(pending[grid][y] & mask))
+				{
+					continue;
+				}
+				uint8_t view = (grid == HUMAN) ? get_human_cell_view(x, y)
+						: get_computer_cell_view(x, y);
+				if (view != shown[grid][y][x])
+				{
+					if (serial_output_space() < CELL_COST + RESET_COST)
+					{
+						return;
+					}
+					send_cell(grid, x, y, view);
+					shown[grid][y][x] = view;
+				}
+				pending[grid][y] &= ~mask;
+			}
+		}
+	}
+}
+
+void board_view_commit(const uint8_t* human_marks,
+		const uint8_t* computer_marks)
+{
+	for (uint8_t y = 0; y < GRID_NUM_ROWS; y++)
+	{
+		pending[HUMAN][y] |= human_marks[y];
+		pending[COMPUTER][y] |= computer_marks[y];
+	}
+	next_y = 0;
+	send_pending();
+	if (attribute)
+	{
+		normal_display_mode();
+		attribute = 0;
+	}
+}
@@ -0,0 +1,51 @@
+/*
+ * board_view.h
+ *
+ * Both game boards drawn on the terminal in text and colour, to the right
+ * of the status rows, so the game can be followed from the terminal. The
+ * frame (headings and labels) is drawn once per game. After that only the
+ * cells whose appearance has changed are sent: the cells marked for
+ * redrawing on the LED matrix (see render.h) are looked up in the game
+ * state (get_human_cell_view() and get_computer_cell_view() in game.h)
+ * and compared with a shadow copy of what the terminal is showing. Cells
+ * which don't fit in the serial output buffer are sent in later frames.
+ *
+ * Columns are lettered A-H and rows numbered 1-8 from the bottom, as in
+ * the battle log. The terminal needs to be at least
+ * BOARD_VIEW_COMPUTER_X + 18 columns wide.
+ */
+
+#ifndef BOARD_VIEW_H_
+#define BOARD_VIEW_H_
+
+#include <stdint.h>
+
+// Heading row (column letters are on the next row and the grid below
+// that, top row first), and the first column of each board
+#define BOARD_VIEW_TOP 2
+#define BOARD_VIEW_HUMAN_X 58
+#define BOARD_VIEW_COMPUTER_X 78
+
+// What a cell shows
+#define VIEW_SEA 0
+#define VIEW_SHIP 1			// unhit ship (computer ships only if visible)
+#define VIEW_PENDING 2		// fired at, waiting for the end of the turn
+#define VIEW_MISS 3
+#define VIEW_HIT 4
+#define VIEW_SUNK 5
+#define VIEW_PLACING 6		// ship being placed during setup
+#define VIEW_BLOCKED 7		// ship being placed, over another ship
+#define NUM_VIEWS 8
+#define VIEW_CURSOR 0x80	// added to the above for the cursor
+
+// Draw the frame and forget what the cells show, so they are all sent
+// again (after the terminal has been cleared)
+void board_view_init(void);
+
+// Send the cells which have changed, out of those marked (one byte of
+// marks per grid row, bit x for column x) and those left over from
+// earlier frames. Called by render_commit_frame().
+void board_view_commit(const uint8_t* human_marks,
+		const uint8_t* computer_marks);
+
+#endif /* BOARD_VIEW_H_ */
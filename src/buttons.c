@@ -2,103 +2,96 @@
  * buttons.c
  *
  * Author: Peter Sutton
- */ 
+ */
 
 #include "buttons.h"
 #include <avr/io.h>
-#include <avr/interrupt.h>
+#include "events.h"
 
-// Global variable to keep track of the last button state so that we 
-// can detect changes when an interrupt fires. The lower 4 bits (0 to 3)
-// will correspond to the last state of port B pins 0 to 3.
-static volatile uint8_t last_button_state;
+#if BUTTON_SAMPLE_PERIOD < 1 || BUTTON_DEBOUNCE_SAMPLES < 1 \
+		|| BUTTON_LONG_PRESS < BUTTON_SAMPLE_PERIOD \
+		|| BUTTON_REPEAT_PERIOD < BUTTON_SAMPLE_PERIOD
+#error "Button times must be at least one sample period"
+#endif
 
-// Our button queue. button_queue[0] is always the head of the queue. If we
-// take something off the queue we just move everything else along. We don't
-// use a circular buffer since it is usually expected that the queue is very
-// short. In most uses it will never have more than 1 element at a time.
-// This button queue can be changed by the interrupt handler below so we should
-// turn off interrupts if we're changing the queue outside the handler.
-#define BUTTON_QUEUE_SIZE 4
-static volatile uint8_t button_queue[BUTTON_QUEUE_SIZE];
-static volatile int8_t queue_length;
+// Milliseconds since the last sample
+static uint8_t sample_ticks;
 
-// Setup interrupt if any of pins B0 to B3 change. We do this
-// using a pin change interrupt. These pins correspond to pin
-// change interrupts PCINT8 to PCINT11 which are covered by
-// Pin change interrupt 1.
-void init_button_interrupts(void)
+// The debounced state of the buttons (bit n is 1 if button n is held), and
+// for each button the number of samples in a row which have differed from
+// it
+static uint8_t button_state;
+static uint8_t change_count[NUM_BUTTONS];
+
+// For each held button, the time (ms) since it was pressed or last
+// repeated. Bit n of repeating is set once button n has been held long
+// enough to repeat.
+static uint16_t held_time[NUM_BUTTONS];
+static uint8_t repeating;
+
+void init_buttons(void)
 {
-	// Enable the interrupt (see datasheet page 77)
-	PCICR |= (1 << PCIE1);
-	
-	// Make sure the interrupt flag is cleared (by writing a 
-	// 1 to it) (see datasheet page 78)
-	PCIFR |= (1 << PCIF1);
-	
-	// Choose which pins we're interested in by setting
-	// the relevant bits in the mask register (see datasheet page 78)
-	PCMSK1 |= (1 << PCINT8) | (1 << PCINT9) | (1 << PCINT10) | (1 << PCINT11);	
-	
-	// Empty the button push queue
-	queue_length = 0;
+	// Buttons held already don't count as pressed
+	button_state = PINB & 0x0F;
+	for (uint8_t button = 0; button < NUM_BUTTONS; button++)
+	{
+		change_count[button] = 0;
+		held_time[button] = 0;
+	}
+	repeating = 0;
+	sample_ticks = 0;
 }
 
-int8_t button_pushed(void)
+void buttons_sample(void)
 {
-	int8_t return_value = NO_BUTTON_PUSHED;	// Assume no button pushed
+	if (++sample_ticks < BUTTON_SAMPLE_PERIOD)
+	{
+		return;
+	}
+	sample_ticks = 0;
 
-	if (queue_length > 0)
+	uint8_t pins = PINB & 0x0F;
+	for (uint8_t button = 0; button < NUM_BUTTONS; button++)
 	{
-		// Remove the first element off the queue and move all the other
-		// entries closer to the front of the queue. We turn off interrupts (if on)
-		// before we make any changes to the queue. If interrupts were on
-		// we turn them back on when done.
-		return_value = button_queue[0];
-		
-		// Save whether interrupts were enabled and turn them off
-		int8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
-		cli();
-		
-		for (uint8_t i = 1; i < queue_length; i++)
-		{
-			button_queue[i - 1] = button_queue[i];
-		}
-		queue_length--;
-		
-		if (interrupts_were_enabled)
+		uint8_t mask = 1 << button;
+		if ((pins ^ button_state) & mask)
 		{
-			// Turn them back on again
-			sei();
+			// Different from the debounced state - count it as a change
+			// once it has stayed different for long enough
+			if (++change_count[button] >= BUTTON_DEBOUNCE_SAMPLES)
+			{
+				change_count[button] = 0;
+				button_state ^= mask;
+				if (button_state & mask)
+				{
+					held_time[button] = 0;
+					repeating &= ~mask;
+					events_add(EVENT_BUTTON, BUTTON_PRESS | button);
+				}
+				else
+				{
+					events_add(EVENT_BUTTON, BUTTON_RELEASE | button);
+				}
+			}
+			continue;
 		}
-	}
-	return return_value;
-}
+		change_count[button] = 0;
 
-// Interrupt handler for a change on buttons
-ISR(PCINT1_vect)
-{
-	// Get the current state of the buttons. We'll compare this with
-	// the last state to see what has changed.
-	uint8_t button_state = PINB & 0x0F;
-	
-	// Iterate over all the buttons and see which ones have changed.
-	// Any button pushes are added to the queue of button pushes (if
-	// there is space). We ignore button releases so we're just looking
-	// for a transition from 0 in the last_button_state bit to a 1 in the 
-	// button_state.
-	for (uint8_t pin = 0; pin < NUM_BUTTONS; pin++)
-	{
-		if (queue_length < BUTTON_QUEUE_SIZE
-				&& (button_state & (1 << pin))
-				&& !(last_button_state & (1 << pin)))
+		if (button_state & mask)
+		{
+			// Held - a long press and then repeats
+			held_time[button] += BUTTON_SAMPLE_PERIOD;
+			if (held_time[button] >= ((repeating & mask) ?
+					BUTTON_REPEAT_PERIOD : BUTTON_LONG_PRESS))
+			{
+				if (!(repeating & mask))
 				{
-			// Add the button push to the queue (and update the
-			// length of the queue
-			button_queue[queue_length++] = pin;
+					events_add(EVENT_BUTTON, BUTTON_LONG | button);
+					repeating |= mask;
+				}
+				events_add(EVENT_BUTTON, BUTTON_REPEAT | button);
+				held_time[button] = 0;
+			}
 		}
 	}
-	
-	// Remember this button state
-	last_button_state = button_state;
 }
@@ -3,9 +3,20 @@
  *
  * Author: Peter Sutton
  *
- * We assume four push buttons (B0 to B3) are connected to pins B0 to B3. We configure
- * pin change interrupts on these pins.
- */ 
+ * We assume four push buttons (B0 to B3) are connected to pins B0 to B3.
+ * The pins are sampled every BUTTON_SAMPLE_PERIOD ms (from the timer 0
+ * interrupt handler) and a button only counts as pressed or released once
+ * its pin has read the same for BUTTON_DEBOUNCE_SAMPLES samples in a row,
+ * so contact bounce is ignored. Changes are added to the input event queue
+ * (see events.h) as EVENT_BUTTON events. The event code is the button
+ * number (0 to 3) plus what happened:
+ *	BUTTON_PRESS	the button was pressed
+ *	BUTTON_RELEASE	the button was released
+ *	BUTTON_LONG		the button has been held for BUTTON_LONG_PRESS ms
+ *	BUTTON_REPEAT	the button is still held - sent with BUTTON_LONG and
+ *					then every BUTTON_REPEAT_PERIOD ms until it is released
+ * The times can be set for the build (e.g. -DBUTTON_REPEAT_PERIOD=50).
+ */
 
 
 #ifndef BUTTONS_H_
@@ -13,26 +24,40 @@
 
 #include <stdint.h>
 
-#define NO_BUTTON_PUSHED (-1)
-#define BUTTON0_PUSHED 0
-#define BUTTON1_PUSHED 1
-#define BUTTON2_PUSHED 2
-#define BUTTON3_PUSHED 3
-
 #define NUM_BUTTONS 4
 
-/* Set up pin change interrupts on pins B0 to B3.
- * It is assumed that global interrupts are off when this function is called
- * and are enabled sometime after this function is called.
+// What happened, in the event code
+#define BUTTON_PRESS 0x00
+#define BUTTON_RELEASE 0x10
+#define BUTTON_LONG 0x20
+#define BUTTON_REPEAT 0x30
+#define BUTTON_NUMBER(code) ((code) & 0x0F)
+#define BUTTON_ACTION(code) ((code) & 0x30)
+
+// Times, in ms
+#ifndef BUTTON_SAMPLE_PERIOD
+#define BUTTON_SAMPLE_PERIOD 5
+#endif
+#ifndef BUTTON_DEBOUNCE_SAMPLES
+#define BUTTON_DEBOUNCE_SAMPLES 4
+#endif
+#ifndef BUTTON_LONG_PRESS
+#define BUTTON_LONG_PRESS 500
+#endif
+#ifndef BUTTON_REPEAT_PERIOD
+#define BUTTON_REPEAT_PERIOD 100
+#endif
+
+/* Start sampling the buttons. Pins B0 to B3 must be inputs. It is assumed
+ * that global interrupts are off when this function is called and are
+ * enabled sometime after this function is called (and that timer 0 is set
+ * up - see timer0.h).
  */
-void init_button_interrupts(void);
+void init_buttons(void);
 
-/* Return the last button pushed (0 to 3) or -1 (NO_BUTTON_PUSHED) if 
- * there are no button pushes to return. (A small queue of button pushes
- * is kept. This function should be called frequently enough to
- * ensure the queue does not overflow. Excess button pushes are
- * discarded.)
+/* Sample the buttons if it is time to. Called every millisecond by the
+ * timer 0 interrupt handler.
  */
-int8_t button_pushed(void);
+void buttons_sample(void);
 
 #endif /* BUTTONS_H_ */
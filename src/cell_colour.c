@@ -0,0 +1,150 @@
+/*
+ * cell_colour.c
+ *
+ * Cell colour tables - see cell_colour.h.
+ *
+ * The tables are filled in by the compiler from the rules below. Each
+ * theme gives a palette entry for each role a cell can have (sea, ship,
+ * hit ship etc.), named <theme>_<role>.
+ */
+
+#include "cell_colour.h"
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include "palette.h"
+
+// Normal theme
+#define NORMAL_SEA				PALETTE_BLACK
+#define NORMAL_SHIP				PALETTE_ORANGE
+#define NORMAL_HIT_SHIP			PALETTE_RED
+#define NORMAL_MISS				PALETTE_GREEN
+#define NORMAL_SUNK				PALETTE_DARK_RED
+#define NORMAL_PENDING			PALETTE_DARK_GREEN
+#define NORMAL_UNFIRED_SEA		PALETTE_DARK_GREEN
+#define NORMAL_UNFIRED_SHIP		PALETTE_DARK_ORANGE
+#define NORMAL_CURSOR			PALETTE_YELLOW
+#define NORMAL_CURSOR_FIRED		PALETTE_DARK_YELLOW
+#define NORMAL_SETUP_OK			PALETTE_GREEN
+#define NORMAL_SETUP_BLOCKED	PALETTE_RED
+
+// Colour blind theme. Roles which are red or green in the normal theme
+// are told apart by brightness (and yellow/orange) instead, and roles
+// which share a dark colour in the normal theme are given different
+// (dithered) shades.
+#define COLOUR_BLIND_SEA			PALETTE_BLACK
+#define COLOUR_BLIND_SHIP			PALETTE_ORANGE
+#define COLOUR_BLIND_HIT_SHIP		PALETTE_RED
+#define COLOUR_BLIND_MISS			PALETTE_MID_YELLOW
+#define COLOUR_BLIND_SUNK			PALETTE_DITHER_DARK_ORANGE
+#define COLOUR_BLIND_PENDING		PALETTE_DITHER_DARK_GREEN
+#define COLOUR_BLIND_UNFIRED_SEA	PALETTE_DARK_GREEN
+#define COLOUR_BLIND_UNFIRED_SHIP	PALETTE_DARK_ORANGE
+#define COLOUR_BLIND_CURSOR			PALETTE_YELLOW
+#define COLOUR_BLIND_CURSOR_FIRED	PALETTE_DARK_YELLOW
+#define COLOUR_BLIND_SETUP_OK		PALETTE_MID_YELLOW
+#define COLOUR_BLIND_SETUP_BLOCKED	PALETTE_RED
+
+// Parts of a cell key and mode
+#define HAS_SHIP(k)		((k) & 1)
+#define FIRED(k)		((k) & 2)
+#define SUNK(k)			((k) & 4)
+#define HIT(k)			((k) & 8)
+#define CHEAT(m)		((m) & CELL_MODE_CHEAT)
+#define SALVO(m)		((m) & CELL_MODE_SALVO)
+#define GAME_OVER(m)	((m) & CELL_MODE_GAME_OVER)
+
+// Colour of a cell that has been hit or fired at (or any ship cell when
+// the cheat is on)
+#define SHOT_COLOUR(t, m, k) \
+	((CHEAT(m) && HAS_SHIP(k)) \
+		? (SUNK(k) ? t##_SUNK : FIRED(k) ? t##_HIT_SHIP : t##_SHIP) \
+	: SUNK(k) ? t##_SUNK \
+	: (HAS_SHIP(k) && HIT(k)) ? t##_HIT_SHIP \
+	: HIT(k) ? t##_MISS \
+	: (FIRED(k) && SALVO(m)) ? t##_PENDING \
+	: t##_SEA)
+
+// Colour of an unfired cell at game over
+#define UNFIRED_COLOUR(t, k) \
+	(HAS_SHIP(k) ? t##_UNFIRED_SHIP : t##_UNFIRED_SEA)
+
+// Human grid - the human's own ships are always shown
+#define HUMAN_CELL(t, m, k) \
+	((GAME_OVER(m) && !FIRED(k)) ? UNFIRED_COLOUR(t, k) \
+	: (HIT(k) || SUNK(k)) ? SHOT_COLOUR(t, m, k) \
+	: HAS_SHIP(k) ? t##_SHIP \
+	: t##_SEA)
+
+// Computer grid - shots waiting for the end of the turn are shown as
+// pending
+#define COMPUTER_CELL(t, m, k) \
+	(GAME_OVER(m) \
+		? (FIRED(k) ? SHOT_COLOUR(t, m, k) : UNFIRED_COLOUR(t, k)) \
+	: (FIRED(k) && !HIT(k) && !(CHEAT(m) && HAS_SHIP(k))) ? t##_PENDING \
+	: SHOT_COLOUR(t, m, k))
+
+#define CELL_KEYS(t, grid, m) \
+	{ grid(t, m, 0), grid(t, m, 1), grid(t, m, 2), grid(t, m, 3), \
+	grid(t, m, 4), grid(t, m, 5), grid(t, m, 6), grid(t, m, 7), \
+	grid(t, m, 8), grid(t, m, 9), grid(t, m, 10), grid(t, m, 11), \
+	grid(t, m, 12), grid(t, m, 13), grid(t, m, 14), grid(t, m, 15) }
+#define CELL_MODES(t, grid) \
+	{ CELL_KEYS(t, grid, 0), CELL_KEYS(t, grid, 1), \
+	CELL_KEYS(t, grid, 2), CELL_KEYS(t, grid, 3), \
+	CELL_KEYS(t, grid, 4), CELL_KEYS(t, grid, 5), \
+	CELL_KEYS(t, grid, 6), CELL_KEYS(t, grid, 7) }
+#define THEME_CELLS(t) \
+	{ CELL_MODES(t, HUMAN_CELL), CELL_MODES(t, COMPUTER_CELL) }
+
+static const PaletteIndex cell_colours
+		[NUM_COLOUR_THEMES][NUM_CELL_GRIDS][NUM_CELL_MODES][NUM_CELL_KEYS]
+		PROGMEM =
+{
+	THEME_CELLS(NORMAL),
+	THEME_CELLS(COLOUR_BLIND)
+};
+
+// Cursor colours, over unfired and fired cells
+static const PaletteIndex cursor_colours[NUM_COLOUR_THEMES][2] PROGMEM =
+{
+	{ NORMAL_CURSOR, NORMAL_CURSOR_FIRED },
+	{ COLOUR_BLIND_CURSOR, COLOUR_BLIND_CURSOR_FIRED }
+};
+
+// Setup colours, over empty cells and ships
+static const PaletteIndex setup_colours[NUM_COLOUR_THEMES][2] PROGMEM =
+{
+	{ NORMAL_SETUP_OK, NORMAL_SETUP_BLOCKED },
+	{ COLOUR_BLIND_SETUP_OK, COLOUR_BLIND_SETUP_BLOCKED }
+};
+
+static uint8_t theme;
+
+void set_colour_theme(uint8_t new_theme)
+{
+	if (new_theme < NUM_COLOUR_THEMES)
+	{
+		theme = new_theme;
+	}
+}
+
+uint8_t get_colour_theme(void)
+{
+	return theme;
+}
+
+PaletteIndex cell_colour(uint8_t grid, uint8_t mode, uint8_t cell)
+{
+	return pgm_read_byte(&cell_colours[theme][grid & 1]
+			[mode & (NUM_CELL_MODES - 1)][CELL_KEY(cell)]);
+}
+
+PaletteIndex cursor_colour(uint8_t cell)
+{
+	return pgm_read_byte(&cursor_colours[theme][(CELL_KEY(cell) & 2) >> 1]);
+}
+
+PaletteIndex setup_colour(uint8_t blocked)
+{
+	return pgm_read_byte(&setup_colours[theme][blocked ? 1 : 0]);
+}
@@ -0,0 +1,52 @@
+/*
+ * cell_colour.h
+ *
+ * Colours of the cells on the game boards, looked up in tables kept in
+ * flash. The tables are indexed by colour theme, grid, mode and cell key,
+ * so finding the colour of a cell is a single table read.
+ */
+
+#ifndef CELL_COLOUR_H_
+#define CELL_COLOUR_H_
+
+#include <stdint.h>
+#include "palette.h"
+
+// The parts of a cell byte (see "Ship byte" in notes.md) that affect its
+// colour. Bit 0 is set if there is a ship, bit 1 if the cell has been
+// fired at, bit 2 if it is sunken and bit 3 if it is hit.
+#define CELL_KEY(cell) (((cell) & 0x07 ? 1 : 0) | (((cell) >> 4) & 0x0E))
+#define NUM_CELL_KEYS 16
+
+// Grids
+#define CELL_GRID_HUMAN 0
+#define CELL_GRID_COMPUTER 1
+#define NUM_CELL_GRIDS 2
+
+// Modes - any combination of these bits
+#define CELL_MODE_NORMAL 0
+#define CELL_MODE_CHEAT 1		// computer ships visible (cheat)
+#define CELL_MODE_SALVO 2		// salvo shots pending (human's salvo turn)
+#define CELL_MODE_GAME_OVER 4	// game over - unfired cells shown dark
+#define NUM_CELL_MODES 8
+
+// Colour themes
+#define COLOUR_THEME_NORMAL 0
+#define COLOUR_THEME_COLOUR_BLIND 1
+#define NUM_COLOUR_THEMES 2
+
+// Choose the colour theme (ignored if invalid) and find out which is in use
+void set_colour_theme(uint8_t theme);
+uint8_t get_colour_theme(void);
+
+// Colour of a cell on the given grid in the given mode
+PaletteIndex cell_colour(uint8_t grid, uint8_t mode, uint8_t cell);
+
+// Colour of the cursor over a cell
+PaletteIndex cursor_colour(uint8_t cell);
+
+// Colour of the ship being placed during setup, over a cell which is
+// empty (blocked = 0) or has a ship (blocked = 1)
+PaletteIndex setup_colour(uint8_t blocked);
+
+#endif /* CELL_COLOUR_H_ */
@@ -0,0 +1,17 @@
+/*
+ * clock.h
+ *
+ * The system clock rate, for every module which needs it (include this
+ * rather than defining F_CPU anywhere else). The build normally defines
+ * F_CPU (board_build.f_cpu in platformio.ini) - the default here is only
+ * used if it doesn't, and matches the ATmega324A's 8MHz clock.
+ */
+
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+#endif /* CLOCK_H_ */
@@ -6,86 +6,99 @@
  */ 
 
 #include "display.h"
-#include <stdio.h>
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include "pixel_colour.h"
 #include "ledmatrix.h"
+#include "animation.h"
 #include "game.h"
+#include "timer0.h"
+#include "viewport.h"
 
-#define ICON_OFFSET 42
-#define ICON_LENGTH 13
+#define SPLASH_LENGTH 57
+#define SPLASH_FRAME_PERIOD 200
+#define SPLASH_DELAY 6
 
+// 'BATTLESHIP' followed by a ship icon, scrolled on launch. Each column
+// holds palette indices (two rows per byte, low nibble first): the text
+// is green, the ship outline is red and the ship internal is yellow.
+static const PaletteMatrixColumn splash_columns[SPLASH_LENGTH] PROGMEM =
+{
+		{0x20, 0x22, 0x22, 0x22}, {0x20, 0x00, 0x02, 0x20}, {0x20, 0x00, 0x02, 0x20}, {0x00, 0x22, 0x20, 0x02},
+		{0x00, 0x00, 0x00, 0x00}, {0x00, 0x22, 0x00, 0x00}, {0x20, 0x00, 0x02, 0x02}, {0x20, 0x00, 0x02, 0x02},
+		{0x00, 0x22, 0x22, 0x00}, {0x20, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x20, 0x00}, {0x20, 0x22, 0x22, 0x02},
+		{0x00, 0x00, 0x20, 0x00}, {0x00, 0x00, 0x20, 0x00}, {0x20, 0x22, 0x22, 0x02}, {0x00, 0x00, 0x20, 0x00},
+		{0x00, 0x00, 0x00, 0x00}, {0x20, 0x22, 0x22, 0x22}, {0x00, 0x00, 0x00, 0x00}, {0x00, 0x22, 0x22, 0x00},
+		{0x20, 0x00, 0x02, 0x02}, {0x20, 0x00, 0x02, 0x02}, {0x00, 0x02, 0x22, 0x00}, {0x00, 0x00, 0x00, 0x00},
+		{0x20, 0x00, 0x02, 0x00}, {0x20, 0x20, 0x20, 0x00}, {0x20, 0x20, 0x20, 0x00}, {0x00, 0x02, 0x20, 0x00},
+		{0x00, 0x00, 0x00, 0x00}, {0x20, 0x22, 0x22, 0x22}, {0x00, 0x00, 0x20, 0x00}, {0x00, 0x00, 0x20, 0x00},
+		{0x20, 0x22, 0x02, 0x00}, {0x00, 0x00, 0x00, 0x00}, {0x20, 0x22, 0x02, 0x02}, {0x00, 0x00, 0x00, 0x00},
+		{0x22, 0x22, 0x22, 0x00}, {0x00, 0x02, 0x20, 0x00}, {0x00, 0x02, 0x20, 0x00}, {0x00, 0x20, 0x02, 0x00},
+		{0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x01, 0x00}, {0x10, 0x11, 0x01, 0x00},
+		{0x11, 0x14, 0x14, 0x00}, {0x41, 0x14, 0x11, 0x00}, {0x41, 0x11, 0x00, 0x00}, {0x41, 0x14, 0x11, 0x00},
+		{0x41, 0x14, 0x10, 0x00}, {0x41, 0x14, 0x11, 0x00}, {0x41, 0x14, 0x44, 0x01}, {0x41, 0x14, 0x44, 0x01},
+		{0x41, 0x14, 0x11, 0x11}, {0x11, 0x14, 0x44, 0x01}, {0x10, 0x11, 0x11, 0x00}, {0x00, 0x00, 0x00, 0x00},
+		{0x00, 0x00, 0x00, 0x00}
+};
 
-// constant value used to display 'BATTLESHIP ??' on launch
-static const uint8_t ship_main[ANIMATION_LENGTH] = 
-		{0xfe,0x92,0x92,0x6c,0x00,0x0c,0x52,0x52,0x3c,0x02,0x20,0x7e,
-		 0x20,0x20,0x7e,0x20,0x00,0xfe,0x00,0x3c,0x52,0x52,0x34,0x00,
-		 0x12,0x2a,0x2a,0x24,0x00,0xfe,0x20,0x20,0x1e,0x00,0x5e,0x00,
-		 0x3f,0x24,0x24,0x18,0x00,0x00,0x10,0x1e,0x2b,0x39,0x0d,0x39,
-		 0x29,0x39,0x49,0x49,0xf9,0x4b,0x3e,0x00,0x00};
-static const uint8_t ship_highlight[ICON_LENGTH] =
-		{0x00, 0x00, 0x16, 0x06, 0x02, 0x06, 0x06, 0x06, 0x36, 0x36, 0x06, 0x36, 0x00};
+static const Animation splash_animation PROGMEM =
+{
+	splash_columns, SPLASH_LENGTH, SPLASH_FRAME_PERIOD,
+	2 * SPLASH_DELAY, SPLASH_DELAY, 1
+};
 
-void show_start_screen(void)
+// Built with VIEWPORT_DEMO (and more than one panel), panel 1 also shows
+// the splash as a board wider than the panel, panning back and forth
+// along it one column per frame (see viewport.h)
+#if defined(VIEWPORT_DEMO) && LEDMATRIX_NUM_PANELS > 1
+#define SHOW_VIEWPORT_DEMO 1
+#define VIEWPORT_DEMO_PANEL 1
+static uint32_t last_pan_time;
+static int8_t pan_direction;
+
+static PaletteIndex splash_cell(uint8_t x, uint8_t y)
 {
-	MatrixColumn column_colour_data;
-	uint8_t col_data;
-		
-	ledmatrix_clear(); // start by clearing the LED matrix
-	for (uint8_t col = 0; col < MATRIX_NUM_COLUMNS; col++)
-	{
-		col_data = ship_main[col];
-		for(uint8_t row = 0; row < MATRIX_NUM_ROWS; row++)
-		{
-			// If the relevant font bit is set, we make this a coloured pixel, else blank
-			if(col_data>>row & 1)
-			{
-				column_colour_data[row] = COLOUR_GREEN;
-			}
-			else
-			{
-				column_colour_data[row] = COLOUR_BLACK;
-			}
-		}
-		ledmatrix_update_column(col, column_colour_data);
-	}
+	uint8_t pair = pgm_read_byte(&splash_columns[x][y >> 1]);
+	return (y & 1) ? (pair >> 4) : (pair & 0x0F);
 }
 
-// Update dynamic start screen based on the frame number (0-31)
-// Note: this is hardcoded to PONG game.
-// Purposefully obfuscated so functionality cannot be copied for movement tasks
-void update_start_screen(int8_t frame_number)
+static void pan_viewport_demo(void)
 {
-	// negative numbers are used to pause the animation at the loop point
-	if (frame_number < 0)
+	uint32_t current_time = get_current_time();
+	if (current_time - last_pan_time < SPLASH_FRAME_PERIOD)
 	{
 		return;
 	}
-	ledmatrix_shift_display_left();
-	
-	// fill in the rightmost column
-	MatrixColumn column_colour_data;
-	uint8_t col_data = ship_main[(frame_number+MATRIX_NUM_COLUMNS-1)%ANIMATION_LENGTH];
-	for(uint8_t row = 0; row < MATRIX_NUM_ROWS; row++)
+	last_pan_time = current_time;
+	if (viewport_x() == 0)
+	{
+		pan_direction = 1;
+	}
+	else if (viewport_x() == SPLASH_LENGTH - MATRIX_NUM_COLUMNS)
 	{
-		// If the relevant font bit is set, we make this a coloured pixel, else blank
-		if(col_data>>row & 1)
-		{
-			// text is green, ship outline is red
-			column_colour_data[row] = (frame_number+MATRIX_NUM_COLUMNS-1)%ANIMATION_LENGTH < ICON_OFFSET ? COLOUR_GREEN : COLOUR_RED;
-		}
-		// because there's only 13 columns with the ship icon, it's more efficient to only store those thirteen columns for the
-		// yellow, but then there needs to be a bunch of maths to account for this offset
-		else  if (frame_number+MATRIX_NUM_COLUMNS-1 >= ICON_OFFSET && frame_number+MATRIX_NUM_COLUMNS-1 < ICON_OFFSET+ICON_LENGTH
-					&& ship_highlight[frame_number+MATRIX_NUM_COLUMNS-1-ICON_OFFSET]>>row & 1)
-		{
-			// ship internal is yellow
-			column_colour_data[row] = COLOUR_YELLOW;
-		}
-		else
-		{
-			column_colour_data[row] = COLOUR_BLACK;
-		}
+		pan_direction = -1;
 	}
-	ledmatrix_update_column(MATRIX_NUM_COLUMNS-1, column_colour_data);
+	viewport_pan(pan_direction, 0);
+}
+#else
+#define SHOW_VIEWPORT_DEMO 0
+#endif
+
+void show_start_screen(void)
+{
+	ledmatrix_clear(); // start by clearing the LED matrix
+	animation_start(&splash_animation);
+#if SHOW_VIEWPORT_DEMO
+	viewport_init(VIEWPORT_DEMO_PANEL, SPLASH_LENGTH, MATRIX_NUM_ROWS,
+			splash_cell);
+	last_pan_time = get_current_time();
+#endif
+}
+
+void update_start_screen(void)
+{
+	animation_service();
+#if SHOW_VIEWPORT_DEMO
+	pan_viewport_demo();
+#endif
 }
@@ -10,13 +10,11 @@
 
 #include "pixel_colour.h"
 
-#define ANIMATION_LENGTH 57
-#define ANIMATION_DELAY 6
-
-// Shows a starting display.
+// Shows a starting display and starts it scrolling.
 void show_start_screen(void);
 
-// Update dynamic start screen based on frame number (0-11)
-void update_start_screen(int8_t frame_number);
+// Scroll the start screen along if it is time to. Call this regularly
+// while the start screen is showing.
+void update_start_screen(void);
 
 #endif /* DISPLAY_H_ */
@@ -0,0 +1,133 @@
+/*
+ * dither.c
+ *
+ * Temporal dithering of the LED matrix - see dither.h.
+ * Timer 1 is used to time sub-frames.
+ */
+
+#include "dither.h"
+#include "clock.h"
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "ledmatrix.h"
+#include "spi.h"
+
+// Timer 1 counts microseconds (system clock divided by 8)
+#if F_CPU != 8000000UL
+#error "dither.c assumes an 8MHz clock (timer 1 counting microseconds)"
+#endif
+#define TIMER1_PRESCALER_BITS (1 << CS11)
+
+// Number of sub-frames started by the timer, and handled by
+// dither_service(). Only the interrupt handler changes subframes_started.
+static volatile uint8_t subframes_started;
+static uint8_t subframes_handled;
+
+static uint8_t phase;
+
+// Statistics being collected, and the last results
+static uint16_t stats_subframes;
+static uint32_t stats_busy_us;
+static uint32_t stats_bytes;
+static uint32_t stats_pause_ticks;
+static uint8_t cpu_percent;
+static uint8_t spi_percent;
+
+void dither_init(void)
+{
+	subframes_started = 0;
+	subframes_handled = 0;
+	phase = 0;
+	stats_subframes = 0;
+	stats_busy_us = 0;
+	stats_bytes = 0;
+	stats_pause_ticks = 0;
+	cpu_percent = 0;
+	spi_percent = 0;
+	
+	// Clear timer 1 on compare match (CTC mode) every sub-frame
+	TCNT1 = 0;
+	OCR1A = DITHER_SUBFRAME_US - 1;
+	TCCR1A = 0;
+	TCCR1B = (1 << WGM12) | TIMER1_PRESCALER_BITS;
+	TIMSK1 |= (1 << OCIE1A);
+	TIFR1 = (1 << OCF1A);
+}
+
+// Percentage of total that part is, at most 100
+static uint8_t percent(uint32_t part, uint32_t total)
+{
+	if (part >= total)
+	{
+		return 100;
+	}
+	return (part * 100) / total;
+}
+
+// Work out the results from the statistics collected so far
+static void update_stats(void)
+{
+	uint32_t total_us = (uint32_t)stats_subframes * DITHER_SUBFRAME_US;
+	cpu_percent = percent(stats_busy_us, total_us);
+	spi_percent = percent(stats_bytes * ledmatrix_byte_period_us()
+			+ SPI_PAUSE_TICKS_US(stats_pause_ticks), total_us);
+	stats_subframes = 0;
+	stats_busy_us = 0;
+	stats_bytes = 0;
+	stats_pause_ticks = 0;
+}
+
+void dither_service(void)
+{
+	uint8_t started = subframes_started;
+	if (started == subframes_handled)
+	{
+		return;
+	}
+	// If we've fallen behind we skip the sub-frames we missed
+	stats_subframes += (uint8_t)(started - subframes_handled);
+	subframes_handled = started;
+	
+	// Nothing needs sending if no dithered entries are being shown
+	if (ledmatrix_showing_dithered())
+	{
+		uint16_t start_time = TCNT1;
+		uint32_t bytes_before = ledmatrix_bytes_sent();
+		uint32_t pause_ticks_before = ledmatrix_command_pause_ticks();
+		
+		phase ^= 1;
+		ledmatrix_set_dither_phase(phase);
+		ledmatrix_send_dithered(DITHER_SUBFRAME_BUDGET);
+		
+		// Assumes we take less than a sub-frame
+		uint16_t end_time = TCNT1;
+		if (end_time < start_time)
+		{
+			end_time += DITHER_SUBFRAME_US;
+		}
+		stats_busy_us += end_time - start_time;
+		stats_bytes += ledmatrix_bytes_sent() - bytes_before;
+		stats_pause_ticks += ledmatrix_command_pause_ticks()
+				- pause_ticks_before;
+	}
+	if (stats_subframes >= DITHER_STATS_SUBFRAMES)
+	{
+		update_stats();
+	}
+}
+
+uint8_t dither_cpu_percent(void)
+{
+	return cpu_percent;
+}
+
+uint8_t dither_spi_percent(void)
+{
+	return spi_percent;
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+	subframes_started++;
+}
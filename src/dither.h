@@ -0,0 +1,55 @@
+/*
+ * dither.h
+ *
+ * Temporal dithering of the LED matrix. Dithered palette entries (see
+ * palette.h) alternate between two colours every sub-frame, which looks
+ * like a shade in between the two. Timer 1 marks the start of each
+ * sub-frame. dither_service() then resends the dithered pixels (with the
+ * usual pixel/row/column commands, whichever is cheapest) in the new
+ * colour, sending at most DITHER_SUBFRAME_BUDGET bytes. Other changes are
+ * left for the next frame (see render.h).
+ *
+ * The cost is measured while dithering runs: the percentage of CPU time
+ * spent in dither_service() and the percentage of SPI bus time it uses
+ * (bytes and the pauses after commands), each averaged over
+ * DITHER_STATS_SUBFRAMES sub-frames (one second) and at most 100.
+ * Nothing is sent if no dithered entries are being shown.
+ */
+
+#ifndef DITHER_H_
+#define DITHER_H_
+
+#include <stdint.h>
+#include "ledmatrix.h"
+
+// Length of a sub-frame (us) - each dithered pixel shows each of its
+// colours 125 times a second. Must be at most 8191.
+#define DITHER_SUBFRAME_US 4000
+
+// Most SPI bytes sent per sub-frame - about half a sub-frame at an SPI
+// clock divider of 32. At the default divider of 128 a byte takes 128us,
+// so a sub-frame only has room for 31 bytes - the budget is then the
+// smallest that still fits a row command (see ledmatrix.h), and dithering
+// uses most of the SPI bus.
+#if LEDMATRIX_SPI_DIVIDER == 128
+#define DITHER_SUBFRAME_BUDGET 18
+#else
+#define DITHER_SUBFRAME_BUDGET 64
+#endif
+
+// Number of sub-frames the statistics are averaged over
+#define DITHER_STATS_SUBFRAMES 250
+
+// Set up timer 1 to time sub-frames. Must be called after
+// ledmatrix_setup().
+void dither_init(void);
+
+// Start a new sub-frame if one is due. Call this regularly (at least
+// once per sub-frame) from the main loop.
+void dither_service(void);
+
+// Cost of dithering over the last DITHER_STATS_SUBFRAMES sub-frames
+uint8_t dither_cpu_percent(void);
+uint8_t dither_spi_percent(void);
+
+#endif /* DITHER_H_ */
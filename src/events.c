@@ -0,0 +1,144 @@
+/*
+ * events.c
+ *
+ * Input event queue - see events.h.
+ *
+ * The queue is a ring like the serial buffers (see serialio.c), but there
+ * are several producers (the interrupt handlers and the main program), so
+ * adding an event is done with interrupts off. Interrupt handlers don't
+ * interrupt each other, so this only matters for the main program. The
+ * main program is the only consumer, and takes events without turning
+ * interrupts off - it reads the event before moving the tail.
+ */
+
+#include "events.h"
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "timer0.h"
+#include "serialio.h"
+
+#define EVENT_QUEUE_MASK (EVENT_QUEUE_SIZE - 1)
+static volatile Event queue[EVENT_QUEUE_SIZE];
+static volatile uint8_t queue_head;
+static volatile uint8_t queue_tail;
+
+// Statistics. lost is changed by interrupt handlers, the rest only by
+// events_get().
+static volatile uint16_t lost;
+static uint16_t taken;
+static uint16_t max_latency;
+static uint32_t total_latency;
+
+void events_init(void)
+{
+	queue_head = queue_tail = 0;
+	lost = 0;
+	taken = 0;
+	max_latency = 0;
+	total_latency = 0;
+}
+
+uint8_t events_add(uint8_t source, uint8_t code)
+{
+	uint8_t added = 0;
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	uint8_t head = queue_head;
+	uint8_t next_head = (head + 1) & EVENT_QUEUE_MASK;
+	if (next_head == queue_tail)
+	{
+		lost++;
+	}
+	else
+	{
+		queue[head].source = source;
+		queue[head].code = code;
+		queue[head].time = (uint16_t)get_current_time();
+		queue_head = next_head;
+		added = 1;
+	}
+	if (interrupts_were_enabled)
+	{
+		sei();
+	}
+	return added;
+}
+
+uint8_t events_get(Event* event)
+{
+	uint8_t tail = queue_tail;
+	if (tail == queue_head)
+	{
+		return 0;
+	}
+	event->source = queue[tail].source;
+	event->code = queue[tail].code;
+	event->time = queue[tail].time;
+	queue_tail = (tail + 1) & EVENT_QUEUE_MASK;
+
+	uint16_t latency = (uint16_t)get_current_time() - event->time;
+	if (latency > max_latency)
+	{
+		max_latency = latency;
+	}
+	total_latency += latency;
+	taken++;
+
+	// The sender may have been asked to wait for room
+	serial_input_taken();
+	return 1;
+}
+
+uint8_t events_waiting(void)
+{
+	return (queue_head - queue_tail) & EVENT_QUEUE_MASK;
+}
+
+void events_clear(void)
+{
+	// Only we move the tail
+	queue_tail = queue_head;
+	serial_input_taken();
+}
+
+uint16_t events_lost(void)
+{
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	uint16_t result = lost;
+	if (interrupts_were_enabled)
+	{
+		sei();
+	}
+	return result;
+}
+
+uint16_t events_taken(void)
+{
+	return taken;
+}
+
+uint16_t events_max_latency(void)
+{
+	return max_latency;
+}
+
+uint32_t events_total_latency(void)
+{
+	return total_latency;
+}
+
+void events_clear_stats(void)
+{
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	lost = 0;
+	if (interrupts_were_enabled)
+	{
+		sei();
+	}
+	taken = 0;
+	max_latency = 0;
+	total_latency = 0;
+}
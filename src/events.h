@@ -0,0 +1,70 @@
+/*
+ * events.h
+ *
+ * A single queue of input events - button pushes, characters from the
+ * serial port and joystick movements - in the order they happened. Each
+ * event records where it came from, what it was and when it happened (in
+ * milliseconds, see get_current_time()), so the game can handle a burst
+ * of input in order and we can measure how long events wait before being
+ * handled.
+ *
+ * Events are added by the button and serial receive interrupt handlers
+ * (and by the joystick code). The game takes them with events_get(),
+ * usually all of the waiting events each time around its loop. Serial
+ * input is flow controlled on the number of events waiting, so a fast
+ * sender is paused rather than losing characters (see serialio.c).
+ */
+
+#ifndef EVENTS_H_
+#define EVENTS_H_
+
+#include <stdint.h>
+
+// Number of events the queue holds (a power of two, at most 256)
+#define EVENT_QUEUE_SIZE 32
+
+// Event sources
+#define EVENT_BUTTON 0		// code is the button (0 to 3)
+#define EVENT_SERIAL 1		// code is the character received
+#define EVENT_JOYSTICK 2	// code is the direction, see below
+
+// Joystick direction: dx and dy are each -1, 0 or 1
+#define JOYSTICK_CODE(dx, dy) ((uint8_t)(((dx) + 1) | (((dy) + 1) << 2)))
+#define JOYSTICK_DX(code) ((int8_t)((code) & 3) - 1)
+#define JOYSTICK_DY(code) ((int8_t)((code) >> 2) - 1)
+
+typedef struct
+{
+	uint8_t source;
+	uint8_t code;
+	uint16_t time;		// low 16 bits of get_current_time()
+} Event;
+
+// Empty the queue and clear the statistics. Must be called (with
+// interrupts off) before any events are added.
+void events_init(void);
+
+// Add an event, timestamped now. Safe to call from interrupt handlers and
+// from the main program. Returns 0 (and counts the event as lost) if the
+// queue is full.
+uint8_t events_add(uint8_t source, uint8_t code);
+
+// Take the oldest event. Returns 0 if there are none.
+uint8_t events_get(Event* event);
+
+// Number of events waiting
+uint8_t events_waiting(void);
+
+// Throw away any waiting events (e.g. keys pressed before a game starts)
+void events_clear(void);
+
+// Statistics since the last events_clear_stats(): events lost because
+// the queue was full, the number of events taken, and the longest and
+// total time (ms) events waited in the queue before being taken.
+uint16_t events_lost(void);
+uint16_t events_taken(void);
+uint16_t events_max_latency(void);
+uint32_t events_total_latency(void);
+void events_clear_stats(void);
+
+#endif /* EVENTS_H_ */
@@ -0,0 +1,98 @@
+/*
+ * fmt.c
+ *
+ * Formatted serial output without printf - see fmt.h.
+ */
+
+#include "fmt.h"
+#include <stdint.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "serialio.h"
+
+void fmt_string(const char* text)
+{
+	serial_write(text, strlen(text));
+}
+
+void fmt_string_P(const char* text)
+{
+	serial_write_P(text, strlen_P(text));
+}
+
+// The AVR has no divide instruction, so digits are found by counting
+// how many times each power of ten can be subtracted
+static const uint16_t powers_of_ten[] PROGMEM = {10000, 1000, 100, 10};
+
+uint8_t fmt_u16_to(char* buffer, uint16_t n)
+{
+	uint8_t length = 0;
+	for (uint8_t i = 0; i < sizeof(powers_of_ten) / sizeof(uint16_t); i++)
+	{
+		uint16_t power = pgm_read_word(&powers_of_ten[i]);
+		char digit = '0';
+		while (n >= power)
+		{
+			n -= power;
+			digit++;
+		}
+		if (length || digit != '0')
+		{
+			buffer[length++] = digit;
+		}
+	}
+	buffer[length++] = '0' + n;
+	buffer[length] = '\0';
+	return length;
+}
+
+void fmt_u16(uint16_t n)
+{
+	char digits[6];
+	fmt_u16_to(digits, n);
+	fmt_string(digits);
+}
+
+void fmt_u8(uint8_t n)
+{
+	if (n >= 10)
+	{
+		char tens = '0';
+		if (n >= 100)
+		{
+			char hundreds = '0';
+			while (n >= 100)
+			{
+				n -= 100;
+				hundreds++;
+			}
+			serial_put_char(hundreds);
+		}
+		while (n >= 10)
+		{
+			n -= 10;
+			tens++;
+		}
+		serial_put_char(tens);
+	}
+	serial_put_char('0' + n);
+}
+
+void fmt_csi(uint8_t n, char c)
+{
+	serial_write_P(PSTR("\x1b["), 2);
+	if (n != 1)
+	{
+		fmt_u8(n);
+	}
+	serial_put_char(c);
+}
+
+void fmt_csi2(uint8_t a, uint8_t b, char c)
+{
+	serial_write_P(PSTR("\x1b["), 2);
+	fmt_u8(a);
+	serial_put_char(';');
+	fmt_u8(b);
+	serial_put_char(c);
+}
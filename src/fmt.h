@@ -0,0 +1,43 @@
+/*
+ * fmt.h
+ *
+ * Small fixed-purpose formatted output to the serial port, for use
+ * instead of printf. Each function writes straight into the serial output
+ * buffer (via serial_write() and serial_put_char()), so output can be
+ * mixed freely with stdio output. Strings are copied in as blocks, and
+ * '\n' in them is sent as it is (not as "\r\n").
+ *
+ * Rough figures (estimates from the avr-libc sources, not measured on the
+ * board): the standard avr-libc vfprintf is about 1.5KB of flash and
+ * printf_P(PSTR("\x1b[%d;%dH"), y, x) takes in the order of 1000-1500
+ * cycles (format parsing, two 16-bit conversions by division and a FILE
+ * call per character). fmt_csi2(y, x, 'H') is a few hundred cycles -
+ * digits are found by subtracting powers of ten - and all of fmt.c is
+ * around 200 bytes. With no printf left, vfprintf is no longer linked.
+ * The division routines still are - rand() % max in game.c and the 32-bit
+ * statistics in dither.c use them.
+ */
+
+#ifndef FMT_H_
+#define FMT_H_
+
+#include <stdint.h>
+
+// Strings (the _P version takes a string in flash (PSTR()))
+void fmt_string(const char* text);
+void fmt_string_P(const char* text);
+
+// Unsigned numbers in decimal, without leading zeros
+void fmt_u8(uint8_t n);
+void fmt_u16(uint16_t n);
+
+// Write n in decimal (and a terminating null) into buffer, which must have
+// room for 6 characters. Returns the number of digits.
+uint8_t fmt_u16_to(char* buffer, uint16_t n);
+
+// Escape sequences: ESC[nc, with n left out when it is 1 (the default for
+// cursor movements), and ESC[a;bc
+void fmt_csi(uint8_t n, char c);
+void fmt_csi2(uint8_t a, uint8_t b, char c);
+
+#endif /* FMT_H_ */
@@ -9,14 +9,19 @@
 #include "game.h"
 #include "project.h"
 #include <stdlib.h>
-#include <stdio.h>
-#include <math.h>
 #include <stdint.h>
 #include "display.h"
 #include "ledmatrix.h"
+#include "render.h"
+#include "cell_colour.h"
 #include "terminalio.h"
+#include "fmt.h"
+#include "telemetry.h"
+#include "battle_log.h"
+#include "board_view.h"
 #include "timer0.h"
 #include "string.h"
+#include <avr/pgmspace.h>
 
 uint8_t human_grid[GRID_NUM_ROWS][GRID_NUM_COLUMNS];
 uint8_t computer_grid[GRID_NUM_ROWS][GRID_NUM_COLUMNS];
@@ -52,6 +57,9 @@ uint8_t num_cells_to_destroy;
 // Cells left to destroy, or 0xFF if invalid
 uint8_t cells_to_destroy[4];
 
+// 1 once the game over colours are shown on the matrix, 0 otherwise
+uint8_t game_over_shown;
+
 // bit 0 is bomb cheat, bit 1 is horiz cheat, bit 2 is vert cheat. 0 if unused, 1 if used
 uint8_t cheats_used;
 
@@ -93,6 +101,7 @@ uint8_t cheat_visible;
 void set_cheat_visible(uint8_t new_val)
 {
 	cheat_visible = new_val;
+	send_modes_telemetry();
 }
 
 /**
@@ -103,11 +112,19 @@ uint8_t get_cheat_visible()
 	return cheat_visible;
 }
 
+/**
+ * @brief Send the game modes as a telemetry frame
+ */
+void send_modes_telemetry()
+{
+	uint8_t payload[] = {(salvo_mode ? 1 : 0) | (computer_mode ? 2 : 0)
+			| (cheat_visible ? 4 : 0) | (get_colour_theme() << 3)};
+	telemetry_send(TELEMETRY_MODES, payload, sizeof(payload));
+}
+
 void check_surroundings(uint8_t x, uint8_t y);
 
 void computer_turn();
-uint8_t get_pixel_colour(uint8_t cell_data);
-uint8_t get_cursor_colour(uint8_t cell_data);
 
 uint8_t const MATRIX_WIDTH = 8;
 uint8_t const FIRE_MASK = (1 << 5);
@@ -206,28 +223,26 @@ uint8_t convert_pos_to_byte(uint8_t x, uint8_t y)
 }
 
 /**
- * @brief Redraw grid for human setup, checks validity (overlapping ships), updates ship start and end
+ * @brief Mark the cells between two position bytes (inclusive) for redrawing on the human grid
  */
-void redraw_human_setup(uint8_t old_start, uint8_t old_end, uint8_t new_start, uint8_t new_end)
+void mark_human_cells(uint8_t start, uint8_t end)
 {
-	uint8_t cell;
-
-	// Redraw old pos
-	for (uint8_t x = get_x(old_start); x <= get_x(old_end); x++)
+	for (uint8_t x = get_x(start); x <= get_x(end); x++)
 	{
-		for (uint8_t y = get_y(old_start); y <= get_y(old_end); y++)
+		for (uint8_t y = get_y(start); y <= get_y(end); y++)
 		{
-			cell = human_grid[y][x];
-			if (cell & SHIP_MASK)
-			{
-				ledmatrix_draw_pixel_in_human_grid(x, y, COLOUR_ORANGE);
-			}
-			else
-			{
-				ledmatrix_draw_pixel_in_human_grid(x, y, COLOUR_BLACK);
-			}
+			render_mark_human_cell(x, y);
 		}
 	}
+}
+
+/**
+ * @brief Redraw grid for human setup, checks validity (overlapping ships), updates ship start and end
+ */
+void redraw_human_setup(uint8_t old_start, uint8_t old_end, uint8_t new_start, uint8_t new_end)
+{
+	// Redraw old pos
+	mark_human_cells(old_start, old_end);
 
 	// Redraw new pos, check if valid
 	ship_setup_valid_pos = 1;
@@ -235,20 +250,14 @@ void redraw_human_setup(uint8_t old_start, uint8_t old_end, uint8_t new_start, u
 	{
 		for (uint8_t y = get_y(new_start); y <= get_y(new_end); y++)
 		{
-			cell = human_grid[y][x];
-			if (cell & SHIP_MASK)
+			if (human_grid[y][x] & SHIP_MASK)
 			{
 				// Ship overlap
 				ship_setup_valid_pos = 0;
-				ledmatrix_draw_pixel_in_human_grid(x, y, COLOUR_RED);
-			}
-			else
-			{
-				// Not overlapping
-				ledmatrix_draw_pixel_in_human_grid(x, y, COLOUR_GREEN);
 			}
 		}
 	}
+	mark_human_cells(new_start, new_end);
 
 	// Update ship setup position
 	ship_setup_start = new_start;
@@ -342,7 +351,7 @@ void place_human_ship()
 				uint8_t is_end = ((x == get_x(ship_setup_start) && y == get_y(ship_setup_start)) ||
 								  (x == get_x(ship_setup_end) && y == get_y(ship_setup_end)));
 				human_grid[y][x] = ship_human_placing | (is_end ? SHIP_END : 0) | (horizontal ? HORIZONTAL : 0);
-				ledmatrix_draw_pixel_in_human_grid(x, y, COLOUR_ORANGE);
+				render_mark_human_cell(x, y);
 			}
 		}
 
@@ -368,16 +377,7 @@ void place_human_ship()
  */
 void draw_human_grid()
 {
-	for (uint8_t i = 0; i < GRID_NUM_COLUMNS; i++)
-	{
-		for (uint8_t j = 0; j < GRID_NUM_COLUMNS; j++)
-		{
-			if (human_grid[j][i] & SHIP_MASK)
-			{
-				ledmatrix_draw_pixel_in_human_grid(i, j, COLOUR_ORANGE);
-			}
-		}
-	}
+	render_mark_human_grid();
 }
 
 /**
@@ -476,8 +476,15 @@ void random_com_grid()
 // Initialise the game by resetting the grid and beat
 void initialise_game(void)
 {
-	// clear the splash screen art
-	ledmatrix_clear();
+	// clear the splash screen art (from every panel)
+	for (uint8_t panel_number = 0; panel_number < LEDMATRIX_NUM_PANELS;
+			panel_number++)
+	{
+		ledmatrix_select_panel(panel_number);
+		ledmatrix_clear();
+	}
+	ledmatrix_select_panel(HUMAN_GRID_PANEL);
+	render_init();
 
 	if (!get_human_setup_mode())
 	{
@@ -564,6 +571,12 @@ void initialise_game(void)
 	com_unhit_cells_left = 64;
 	num_cells_to_destroy = 0;
 	human_unhit_cells_left = 64;
+
+	game_over_shown = 0;
+	render_mark_computer_grid();
+
+	uint8_t payload[] = {salvo_mode, computer_mode};
+	telemetry_send(TELEMETRY_GAME_START, payload, sizeof(payload));
 }
 
 /**
@@ -599,11 +612,17 @@ void check_for_sunken(uint8_t turn, uint8_t cell_just_hit)
 	if (!unhit_found)
 	{
 		// New sunken ship
+		uint8_t payload[] = {turn, ship};
+		telemetry_send(TELEMETRY_SUNK, payload, sizeof(payload));
+		battle_log_sunk(turn, SHIP_NAMES[ship - 1]);
 		if (turn)
 		{
 			// Computer turn, I sunk your
+			begin_priority_output();
 			move_terminal_cursor(0, ++human_ships_sunk + 1);
-			printf("I Sunk Your %s", SHIP_NAMES[ship - 1]);
+			fmt_string_P(PSTR("I Sunk Your "));
+			fmt_string(SHIP_NAMES[ship - 1]);
+			end_priority_output();
 			for (uint8_t i = 0; i < 8; i++)
 			{
 				for (uint8_t j = 0; j < 8; j++)
@@ -611,7 +630,7 @@ void check_for_sunken(uint8_t turn, uint8_t cell_just_hit)
 					if ((human_grid[i][j] & SHIP_MASK) == ship)
 					{
 						human_grid[i][j] |= SUNKEN_MASK;
-						ledmatrix_draw_pixel_in_human_grid(j, i, COLOUR_DARK_RED);
+						render_mark_human_cell(j, i);
 					}
 				}
 			}
@@ -619,8 +638,11 @@ void check_for_sunken(uint8_t turn, uint8_t cell_just_hit)
 		else
 		{
 			// Human turn, You Sunk My
+			begin_priority_output();
 			move_terminal_cursor(40 - strlen(SHIP_NAMES[ship - 1]), ++computer_ships_sunk + 1);
-			printf("You Sunk My %s", SHIP_NAMES[ship - 1]);
+			fmt_string_P(PSTR("You Sunk My "));
+			fmt_string(SHIP_NAMES[ship - 1]);
+			end_priority_output();
 			for (uint8_t i = 0; i < 8; i++)
 			{
 				for (uint8_t j = 0; j < 8; j++)
@@ -628,7 +650,7 @@ void check_for_sunken(uint8_t turn, uint8_t cell_just_hit)
 					if ((computer_grid[i][j] & SHIP_MASK) == ship)
 					{
 						computer_grid[i][j] |= SUNKEN_MASK;
-						ledmatrix_draw_pixel_in_computer_grid(j, i, COLOUR_DARK_RED);
+						render_mark_computer_cell(j, i);
 					}
 				}
 			}
@@ -659,8 +681,7 @@ void fire(uint8_t turn, uint8_t x, uint8_t y)
 		// Human turn
 
 		// Clear invalid move msg
-		move_terminal_cursor(0, 0);
-		clear_to_end_of_line();
+		set_terminal_line_P(0, 1, PSTR(""));
 
 		invalid_move_count = 0;
 
@@ -675,20 +696,14 @@ void fire(uint8_t turn, uint8_t x, uint8_t y)
 	}
 	if (not_already_fired_at)
 	{
+		uint8_t payload[] = {turn, x, y,
+				turn ? human_grid[y][x] : computer_grid[y][x]};
+		telemetry_send(TELEMETRY_FIRE, payload, sizeof(payload));
 		shots_to_update[cells_fired] = convert_pos_to_byte(x, y);
 		cells_fired++;
 		if (!turn)
 		{
-			// Update cursor on matrix if needed
-			if ((x == cursor_x) && (y == cursor_y))
-			{
-				cursor_on = !cursor_on;
-				flash_cursor();
-			}
-			else
-			{
-				ledmatrix_draw_pixel_in_computer_grid(x, y, COLOUR_DARK_GREEN);
-			}
+			render_mark_computer_cell(x, y);
 		}
 	}
 }
@@ -704,6 +719,7 @@ void complete_turn(uint8_t turn)
 	// Update matrix
 	uint8_t ship_data;
 	uint8_t pos_byte, x, y;
+	uint8_t hits = 0;
 
 	for (uint8_t i = 0; i < cells_fired; i++)
 	{
@@ -716,28 +732,24 @@ void complete_turn(uint8_t turn)
 			// Com turn
 			human_grid[y][x] |= HIT_MASK;
 			ship_data = human_grid[y][x];
-			ledmatrix_draw_pixel_in_human_grid(
-				x, y, get_pixel_colour(ship_data));
+			render_mark_human_cell(x, y);
 		}
 		else
 		{
 			// Human turn
 			computer_grid[y][x] |= HIT_MASK;
 			ship_data = computer_grid[y][x];
-			// Update cursor on matrix if needed
-			if ((x == cursor_x) && (y == cursor_y))
-			{
-				cursor_on = !cursor_on;
-				flash_cursor();
-			}
-			else
-			{
-				ledmatrix_draw_pixel_in_computer_grid(
-					x, y, get_pixel_colour(ship_data));
-			}
+			render_mark_computer_cell(x, y);
 		}
+		uint8_t hit = (ship_data & SHIP_MASK) != SEA;
+		hits += hit;
+		battle_log_shot(turn, x, y, hit);
 		check_for_sunken(turn, ship_data);
 	}
+	if (cells_fired > 1)
+	{
+		battle_log_salvo(turn, cells_fired, hits);
+	}
 
 	// If com turn finished and in salvo mode, enter human salvo mode
 	human_salvo_mode = (turn == 1 && salvo_mode);
@@ -749,6 +761,10 @@ void complete_turn(uint8_t turn)
 	{
 		salvo_shot_limit++;
 	}
+
+	uint8_t payload[] = {turn, com_unhit_cells_left, human_unhit_cells_left,
+			salvo_shot_limit};
+	telemetry_send(TELEMETRY_TURN, payload, sizeof(payload));
 }
 
 /**
@@ -756,9 +772,7 @@ void complete_turn(uint8_t turn)
  */
 void invalid_move_msg()
 {
-	move_terminal_cursor(0, 1);
-	clear_to_end_of_line();
-	printf("%s", INVALID_MOVE_MESSAGES[invalid_move_count]);
+	set_terminal_line(0, 1, INVALID_MOVE_MESSAGES[invalid_move_count]);
 	if (invalid_move_count < 2)
 	{
 		invalid_move_count++;
@@ -794,20 +808,16 @@ uint8_t human_turn()
  */
 void show_cheat()
 {
-	uint8_t cell;
 	for (uint8_t x = 0; x < 8; x++)
 	{
 		for (uint8_t y = 0; y < 8; y++)
 		{
-			cell = computer_grid[y][x];
-			if (cell & SHIP_MASK)
+			if (computer_grid[y][x] & SHIP_MASK)
 			{
-				ledmatrix_draw_pixel_in_computer_grid(x, y, get_pixel_colour(cell));
+				render_mark_computer_cell(x, y);
 			}
 		}
 	}
-	cursor_on = !cursor_on;
-	flash_cursor();
 }
 
 /**
@@ -1105,110 +1115,104 @@ void computer_turn()
 	shots_fired++;
 }
 
-// Gets pixel colour based on whether there is a ship and whether a shot has been fired at that position,
-// not used for cursor colour
-uint8_t get_pixel_colour(uint8_t cell_data)
+// Colour mode (see cell_colour.h) from the game state
+uint8_t get_colour_mode()
 {
-	// Whether there is a ship at the current location
-	uint8_t has_ship = cell_data & SHIP_MASK;
-	// Whether the current location has been fired at
-	uint8_t hit = cell_data & HIT_MASK;
-	uint8_t fired = cell_data & FIRE_MASK;
-	// Whether the current location is sunken
-	uint8_t sunken = cell_data & SUNKEN_MASK;
-
-	if (get_cheat_visible() && has_ship)
-	{
-		if (sunken)
-		{
-			return COLOUR_DARK_RED;
-		}
-		else if (fired)
-		{
-			return COLOUR_RED;
-		}
-		else
-		{
-			return COLOUR_ORANGE;
-		}
-	}
-
-	if (sunken)
+	uint8_t mode = CELL_MODE_NORMAL;
+	if (get_cheat_visible())
 	{
-		// Sunken
-		return COLOUR_DARK_RED;
+		mode |= CELL_MODE_CHEAT;
 	}
-	else if (has_ship && hit)
+	if (human_salvo_mode)
 	{
-		// Hit ship
-		return COLOUR_RED;
+		mode |= CELL_MODE_SALVO;
 	}
-	else if (hit)
+	if (game_over_shown)
 	{
-		// Hit but no ship
-		return COLOUR_GREEN;
+		mode |= CELL_MODE_GAME_OVER;
 	}
-	else if (fired && human_salvo_mode)
+	return mode;
+}
+
+// Colour of a cell on the human grid, from the grid state
+PaletteIndex get_human_cell_colour(uint8_t x, uint8_t y)
+{
+	uint8_t cell = human_grid[y][x];
+
+	// Ship being placed is shown over the grid during setup
+	if (human_setup_mode && !game_over_shown
+		&& get_x(ship_setup_start) <= x && x <= get_x(ship_setup_end)
+		&& get_y(ship_setup_start) <= y && y <= get_y(ship_setup_end))
 	{
-		return COLOUR_DARK_GREEN;
+		return setup_colour(cell & SHIP_MASK);
 	}
-	else
+	return cell_colour(CELL_GRID_HUMAN, get_colour_mode(), cell);
+}
+
+// Colour of a cell on the computer grid, from the grid state and cursor
+PaletteIndex get_computer_cell_colour(uint8_t x, uint8_t y)
+{
+	uint8_t cell = computer_grid[y][x];
+
+	// Cursor is hidden at game over
+	if (!game_over_shown && cursor_on && x == cursor_x && y == cursor_y)
 	{
-		// Nothing, just sea
-		return COLOUR_BLACK;
+		return cursor_colour(cell);
 	}
+	return cell_colour(CELL_GRID_COMPUTER, get_colour_mode(), cell);
 }
 
-// Gets pixel colour for cursor
-uint8_t get_cursor_colour(uint8_t cell_data)
+// View of a cell on the terminal board, from the cell byte
+uint8_t cell_view(uint8_t cell, uint8_t ship_visible)
 {
-	// Whether the current location has been fired at
-	uint8_t fired = cell_data & FIRE_MASK;
-	if (fired)
+	uint8_t ship = cell & SHIP_MASK;
+	if (cell & SUNKEN_MASK)
 	{
-		return COLOUR_DARK_YELLOW;
+		return VIEW_SUNK;
 	}
-	else
+	if (cell & HIT_MASK)
 	{
-		return COLOUR_YELLOW;
+		return ship ? VIEW_HIT : VIEW_MISS;
 	}
+	if (fired_at(cell))
+	{
+		return VIEW_PENDING;
+	}
+	return (ship && ship_visible) ? VIEW_SHIP : VIEW_SEA;
 }
 
-void flash_cursor(void)
+// View of a cell on the human grid, from the grid state
+uint8_t get_human_cell_view(uint8_t x, uint8_t y)
 {
-	cursor_on = 1 - cursor_on;
-
-	// Ship info at current location
-	uint8_t ship_data = computer_grid[cursor_y][cursor_x];
+	uint8_t cell = human_grid[y][x];
 
-	// Cursor on, show yellow/dark yellow
-	if (cursor_on)
+	// Ship being placed is shown over the grid during setup
+	if (human_setup_mode && !game_over_shown
+		&& get_x(ship_setup_start) <= x && x <= get_x(ship_setup_end)
+		&& get_y(ship_setup_start) <= y && y <= get_y(ship_setup_end))
 	{
-		ledmatrix_draw_pixel_in_computer_grid(cursor_x, cursor_y, get_cursor_colour(ship_data));
-		return;
+		return (cell & SHIP_MASK) ? VIEW_BLOCKED : VIEW_PLACING;
 	}
+	return cell_view(cell, 1);
+}
 
-	// Cursor off, see if it should be dark green
-	if (human_salvo_mode)
+// View of a cell on the computer grid, from the grid state and cursor.
+// The cursor doesn't flash on the terminal, so flashing sends nothing.
+uint8_t get_computer_cell_view(uint8_t x, uint8_t y)
+{
+	uint8_t view = cell_view(computer_grid[y][x],
+			get_cheat_visible() || game_over_shown);
+	if (!game_over_shown && x == cursor_x && y == cursor_y)
 	{
-		uint8_t pos_byte, x, y;
-		for (uint8_t i = 0; i < cells_fired; i++)
-		{
-			pos_byte = shots_to_update[i];
-			x = get_x(pos_byte);
-			y = get_y(pos_byte);
-			if ((x == cursor_x) && (y == cursor_y)/* && !(cell & SHIP_MASK)*/)
-			{
-				// Colour dark green
-				ledmatrix_draw_pixel_in_computer_grid(cursor_x, cursor_y, COLOUR_DARK_GREEN);
-				return;
-			}
-		}
+		view |= VIEW_CURSOR;
 	}
+	return view;
+}
 
-	// Cursor off, normal colour
-	ledmatrix_draw_pixel_in_computer_grid(
-		cursor_x, cursor_y, get_pixel_colour(ship_data));
+void flash_cursor(void)
+{
+	cursor_on = 1 - cursor_on;
+	render_mark_computer_cell(cursor_x, cursor_y);
 }
 
 // moves the position of the cursor by (dx, dy) such that if the cursor
@@ -1229,8 +1233,8 @@ void move_cursor(int8_t dx, int8_t dy)
 	 *		is flashed.
 	 */
 
-	cursor_on = 1;
-	flash_cursor(); // Set cursor_on to 0, replace initial cursor position
+	// Replace initial cursor position with whatever is there
+	render_mark_computer_cell(cursor_x, cursor_y);
 
 	// Update positional knowledge of cursor
 	cursor_x += dx;
@@ -1252,10 +1256,13 @@ void move_cursor(int8_t dx, int8_t dy)
 		cursor_y = 7;
 	}
 
-	// Flash new cursor
-	cursor_on = 0;
-	flash_cursor();						  // Set cursor_on to 1, flash cursor
+	// Show new cursor
+	cursor_on = 1;
+	render_mark_computer_cell(cursor_x, cursor_y);
 	last_flash_time = get_current_time(); // Reset flashing cycle
+
+	uint8_t payload[] = {cursor_x, cursor_y};
+	telemetry_send(TELEMETRY_CURSOR, payload, sizeof(payload));
 }
 
 // Returns 1 if the human won, 2 if the computer won, 0 otherwise.
@@ -1325,39 +1332,19 @@ void show_high_score() {
 
 	high_score = ship_score * accuracy_score;
 
-	move_terminal_cursor(0, 16);
-	clear_to_end_of_line();
-	printf("Your score: %i", high_score);
+	static const char score_label[] PROGMEM = "Your score: ";
+	char score_text[sizeof(score_label) + 5];
+	strcpy_P(score_text, score_label);
+	fmt_u16_to(score_text + sizeof(score_label) - 1, high_score);
+	set_terminal_line(0, 16, score_text);
 }
 
 // Colour LED matrix for game over
 void game_over_matrix()
 {
-	for (uint8_t player = 0; player < 2; player++)
-	{
-		for (uint8_t i = 0; i < 8; i++)
-		{
-			for (uint8_t j = 0; j < 8; j++)
-			{
-				uint8_t cell = player ? human_grid[i][j] : computer_grid[i][j];
-				if (!(cell & FIRE_MASK))
-				{
-					// Has not been fired at
-					uint8_t colour = (cell & SHIP_MASK) ? COLOUR_DARK_ORANGE : COLOUR_DARK_GREEN;
-					if (player)
-					{
-						ledmatrix_draw_pixel_in_human_grid(j, i, colour);
-					}
-					else
-					{
-						ledmatrix_draw_pixel_in_computer_grid(j, i, colour);
-					}
-				}
-			}
-		}
-	}
-	// Fix matrix colour at cursor to hide cursor yellow
-	ledmatrix_draw_pixel_in_computer_grid(
-		cursor_x, cursor_y,
-		get_pixel_colour(computer_grid[cursor_y][cursor_x]));
-}
\ No newline at end of file
+	// Unfired cells are shown dark and the cursor is hidden,
+	// see get_human_cell_colour() and get_computer_cell_colour()
+	game_over_shown = 1;
+	render_mark_human_grid();
+	render_mark_computer_grid();
+}
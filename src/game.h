@@ -12,6 +12,8 @@
 #define GAME_H_
 
 #include <stdint.h>
+#include "pixel_colour.h"
+#include "palette.h"
 
 // Initialise the game by resetting the grid and beat
 void initialise_game(void);
@@ -19,6 +21,16 @@ void initialise_game(void);
 // flash the cursor
 void flash_cursor(void);
 
+// Colour of a cell on each grid (0-7 x, 0-7 y), worked out from the game
+// state. Used by render.c to draw the boards.
+PaletteIndex get_human_cell_colour(uint8_t x, uint8_t y);
+PaletteIndex get_computer_cell_colour(uint8_t x, uint8_t y);
+
+// What a cell on each grid shows on the terminal (VIEW_... in
+// board_view.h), worked out from the game state. Used by board_view.c.
+uint8_t get_human_cell_view(uint8_t x, uint8_t y);
+uint8_t get_computer_cell_view(uint8_t x, uint8_t y);
+
 // move the cursor in the x and/or y direction
 void move_cursor(int8_t dx, int8_t dy);
 
@@ -95,6 +107,11 @@ void set_cheat_visible(uint8_t new_val);
  * @brief Get cheat visible, 1 if visible
  */
 uint8_t get_cheat_visible();
+/**
+ * @brief Send the game modes (salvo, computer, cheat, colour theme) as a
+ * telemetry frame. Called whenever one of them changes.
+ */
+void send_modes_telemetry();
 /**
  * @brief Update all matrix cells with a ship, used for cheats
  */
@@ -0,0 +1,135 @@
+/*
+ * joystick.c
+ *
+ * Background joystick sampling and the cursor motion model - see
+ * joystick.h.
+ *
+ * The ADC runs in auto trigger mode with timer 0 compare match A as the
+ * trigger, so a conversion starts every millisecond without any code
+ * running (the timer 0 interrupt handler clears the compare match flag,
+ * which gives the next trigger). At a 125kHz ADC clock a conversion takes
+ * about 0.1ms, so the interrupt handler can switch to the other axis long
+ * before the next conversion starts.
+ */
+
+#include "joystick.h"
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#if (1023UL << (JOYSTICK_OVERSAMPLE_SHIFT + JOYSTICK_FILTER_SHIFT)) > 0xFFFF
+#error "Joystick filter state wouldn't fit in 16 bits"
+#endif
+
+// Filter state for each axis: the filtered sum of JOYSTICK_OVERSAMPLE
+// readings, times 2^JOYSTICK_FILTER_SHIFT
+#define STATE_SHIFT (JOYSTICK_OVERSAMPLE_SHIFT + JOYSTICK_FILTER_SHIFT)
+static volatile uint16_t filter_state[2];
+
+// Readings of the current axis (ADMUX bit 0) so far
+static uint16_t sample_sum;
+static uint8_t sample_count;
+
+// Wait (ms) between cursor moves for each step of JOYSTICK_STEP in how far
+// the joystick is pushed past the dead zone (at most about 580). Matches
+// the old 600 - distance rule, but can be any shape.
+#define JOYSTICK_STEP 32
+static const uint16_t move_delays[] PROGMEM =
+{
+	584, 552, 520, 488, 456, 424, 392, 360, 328, 296,
+	264, 232, 200, 168, 136, 104, 72, 40, 20
+};
+#define NUM_MOVE_DELAYS (sizeof(move_delays) / sizeof(move_delays[0]))
+
+void init_joystick(void)
+{
+	// Start from upright
+	filter_state[0] = filter_state[1] = JOYSTICK_CENTRE << STATE_SHIFT;
+	sample_sum = 0;
+	sample_count = 0;
+
+	// AVCC reference, x axis first
+	ADMUX = (1 << REFS0);
+	// Trigger on timer 0 compare match A
+	ADCSRB = (1 << ADTS1) | (1 << ADTS0);
+	// Enable with auto trigger and interrupt, clock divided by 64
+	ADCSRA = (1 << ADEN) | (1 << ADATE) | (1 << ADIE)
+			| (1 << ADPS2) | (1 << ADPS1);
+}
+
+void joystick_read(uint16_t* x, uint16_t* y)
+{
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	uint16_t state_x = filter_state[0];
+	uint16_t state_y = filter_state[1];
+	if (interrupts_were_enabled)
+	{
+		sei();
+	}
+	*x = state_x >> STATE_SHIFT;
+	*y = state_y >> STATE_SHIFT;
+}
+
+// Distance of a reading past the dead zone (negative below the centre)
+static int16_t deflection(uint16_t reading)
+{
+	if (reading > JOYSTICK_CENTRE + JOYSTICK_DEAD_ZONE)
+	{
+		return reading - (JOYSTICK_CENTRE + JOYSTICK_DEAD_ZONE);
+	}
+	if (reading < JOYSTICK_CENTRE - JOYSTICK_DEAD_ZONE)
+	{
+		return (int16_t)reading - (JOYSTICK_CENTRE - JOYSTICK_DEAD_ZONE);
+	}
+	return 0;
+}
+
+uint16_t joystick_motion(int8_t* dx, int8_t* dy)
+{
+	uint16_t x, y;
+	joystick_read(&x, &y);
+	int16_t delta_x = deflection(x);
+	int16_t delta_y = deflection(y);
+	*dx = (delta_x > 0) - (delta_x < 0);
+	*dy = (delta_y > 0) - (delta_y < 0);
+	if (!delta_x && !delta_y)
+	{
+		return 0;
+	}
+
+	// Distance pushed, roughly: the larger plus 3/8 of the smaller
+	// distance along an axis is within about 7% of the true distance
+	uint16_t ax = (delta_x < 0) ? -delta_x : delta_x;
+	uint16_t ay = (delta_y < 0) ? -delta_y : delta_y;
+	uint16_t distance = (ax > ay) ? ax + 3 * ay / 8 : ay + 3 * ax / 8;
+
+	uint8_t step = distance / JOYSTICK_STEP;
+	if (step >= NUM_MOVE_DELAYS)
+	{
+		step = NUM_MOVE_DELAYS - 1;
+	}
+	return pgm_read_word(&move_delays[step]);
+}
+
+ISR(ADC_vect)
+{
+	sample_sum += ADC;
+	if (++sample_count < JOYSTICK_OVERSAMPLE)
+	{
+		return;
+	}
+
+	// state += sum - state / 2^JOYSTICK_FILTER_SHIFT, which settles at
+	// sum * 2^JOYSTICK_FILTER_SHIFT (unsigned wrap-around in the middle
+	// is fine)
+	uint8_t axis = ADMUX & 1;
+	uint16_t state = filter_state[axis];
+	filter_state[axis] = state + sample_sum - (state >> JOYSTICK_FILTER_SHIFT);
+
+	// On to the other axis (its next conversion hasn't started yet)
+	ADMUX ^= 1;
+	sample_sum = 0;
+	sample_count = 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * joystick.h
+ *
+ * The joystick's two axes (ADC0 is x, ADC1 is y) are sampled in the
+ * background. Conversions are started by timer 0 every millisecond,
+ * alternating between the axes, and the ADC interrupt handler adds up
+ * JOYSTICK_OVERSAMPLE readings of an axis and smooths the sums with a
+ * first order low-pass (IIR) filter. Reading the joystick only copies the
+ * latest filtered values - nothing waits for the ADC. All of the
+ * arithmetic is integer.
+ */
+
+#ifndef JOYSTICK_H_
+#define JOYSTICK_H_
+
+#include <stdint.h>
+
+// Readings added up per filter update (a power of two), and the filter's
+// time constant in updates as a power of two - each update moves the
+// filtered value 1/2^JOYSTICK_FILTER_SHIFT of the way to the new sum
+#define JOYSTICK_OVERSAMPLE_SHIFT 2
+#define JOYSTICK_OVERSAMPLE (1 << JOYSTICK_OVERSAMPLE_SHIFT)
+#define JOYSTICK_FILTER_SHIFT 2
+
+// Readings within this distance of the centre count as upright
+#define JOYSTICK_CENTRE 511
+#define JOYSTICK_DEAD_ZONE 100
+
+// Set up the ADC and start sampling. Timer 0 must be set up (see
+// timer0.h). Interrupts should be off and are turned on afterwards.
+void init_joystick(void);
+
+// Latest filtered readings, 0 to 1023
+void joystick_read(uint16_t* x, uint16_t* y);
+
+// Which way the cursor should move (dx and dy are each -1, 0 or 1) and
+// how long (ms) to wait before moving it again - shorter the further the
+// joystick is pushed. When the joystick is upright dx and dy are 0 and
+// the wait is 0, so that a push is noticed straight away.
+uint16_t joystick_motion(int8_t* dx, int8_t* dy);
+
+#endif /* JOYSTICK_H_ */
@@ -4,13 +4,40 @@
  * Author: Peter Sutton
  *
  * See the LED matrix Reference for details of the SPI commands used.
+ *
+ * We keep a copy of what the matrix is showing (shown) and what it has
+ * been asked to show (pending). Only pixels which differ are sent, and
+ * they are sent with whichever mix of pixel, row, column, update all and
+ * clear commands needs the fewest bytes. Both copies hold palette indices
+ * (see palette.h), which are turned back into colours as they are sent.
+ *
+ * Several panels can share the SPI bus, each with its own slave select
+ * line. Each panel has its own copies of the display, and panels with
+ * nothing to update are not sent anything.
  */
 
 #include "ledmatrix.h"
 #include <stdint.h>
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include "spi.h"
 
+#if LEDMATRIX_NUM_PANELS < 1 || LEDMATRIX_NUM_PANELS > 7
+#error "LEDMATRIX_NUM_PANELS must be between 1 and 7"
+#endif
+
+// The serial RTS line (see serialio.h) is on port D unless SERIAL_RTS_PORT
+// says otherwise, where it mustn't be a UART pin or a slave select line
+#if defined(SERIAL_RTS_BIT) && !defined(SERIAL_RTS_PORT) \
+		&& SERIAL_RTS_BIT <= LEDMATRIX_NUM_PANELS
+#error "SERIAL_RTS_BIT is a UART or panel slave select pin of port D"
+#endif
+
+#if LEDMATRIX_SPI_DIVIDER != 8 && LEDMATRIX_SPI_DIVIDER != 16 \
+		&& LEDMATRIX_SPI_DIVIDER != 32 && LEDMATRIX_SPI_DIVIDER != 128
+#error "LEDMATRIX_SPI_DIVIDER must be 8, 16, 32 or 128"
+#endif
+
 #define CMD_UPDATE_ALL		(0x00)
 #define CMD_UPDATE_PIXEL	(0x01)
 #define CMD_UPDATE_ROW		(0x02)
@@ -18,56 +45,759 @@
 #define CMD_SHIFT_DISPLAY	(0x04)
 #define CMD_CLEAR_SCREEN	(0x0F)
 
+// Number of bytes sent for each command
+#define UPDATE_ALL_COST		(1 + MATRIX_NUM_COLUMNS * MATRIX_NUM_ROWS)
+#define UPDATE_PIXEL_COST	(3)
+#define UPDATE_ROW_COST		(2 + MATRIX_NUM_COLUMNS)
+#define UPDATE_COL_COST		(2 + MATRIX_NUM_ROWS)
+#define SHIFT_DISPLAY_COST	(2)
+#define CLEAR_SCREEN_COST	(1)
+
+// Pacing model for the faster SPI speeds. The matrix deals with each byte
+// as it arrives and carries out a command once its last byte has arrived.
+// We make sure bytes are at least MIN_BYTE_SPACING_US apart, and after the
+// last byte of a command we pause for as long as the matrix takes to carry
+// out that command (see command_pause()). At a divider of 128 bytes are
+// 128us apart, which the matrix can always keep up with, so we don't pause.
+// (A byte takes 8 SPI clocks, i.e. LEDMATRIX_SPI_DIVIDER us at 8MHz.)
+#define BYTE_TIME_US		(LEDMATRIX_SPI_DIVIDER * 8 / (F_CPU / 1000000UL))
+#define MIN_BYTE_SPACING_US	(16)
+#if LEDMATRIX_SPI_DIVIDER == 128
+#define PACED				(0)
+#else
+#define PACED				(1)
+#endif
+#if PACED && BYTE_TIME_US < MIN_BYTE_SPACING_US
+#define BYTE_PAUSE			SPI_PAUSE_TICKS(MIN_BYTE_SPACING_US - BYTE_TIME_US)
+#else
+#define BYTE_PAUSE			(0)
+#endif
+
+// Bit masks with one bit per column (bit x is column x)
+typedef uint16_t RowMask[MATRIX_NUM_ROWS];
+#define ALL_COLUMNS ((uint16_t)0xFFFF)
+
+// What each panel is showing and has been asked to show. Pixels which
+// need to be sent are dirty - either pending differs from shown or we
+// don't know what the panel is showing there (stale). Pixels showing a
+// dithered palette entry are marked in dithered so that they can be
+// resent when the dithering phase changes.
+typedef struct
+{
+	PaletteMatrixData shown;
+	PaletteMatrixData pending;
+	RowMask dirty;
+	RowMask stale;
+	RowMask dithered;
+} PanelState;
+
+static PanelState panels[LEDMATRIX_NUM_PANELS];
+
+// The panel that updates apply to (see ledmatrix_select_panel()) and the
+// panel being updated or sent to by the functions below
+static uint8_t selected_panel;
+static PanelState* panel;
+
+// The panel whose slave select line is low, i.e. the one receiving bytes
+static uint8_t bus_panel;
+
+// Dithering phase (0 or 1) - which colour dithered palette entries are
+// sent as
+static uint8_t dither_phase;
+
+// Panel to send first when the next batch ends. We take turns so that a
+// busy panel can't use up the whole budget every frame.
+static uint8_t first_panel_to_send;
+
+// Batches of updates are only sent when the outermost batch ends
+static uint8_t batch_depth;
+
+// Bytes that may still be sent by the current send_dirty_pixels() call
+static uint16_t budget_left;
+
+// Bytes that the update calls would have sent on their own, bytes
+// actually sent, and the pause ticks after commands beyond the usual
+// spacing between bytes
+static uint32_t bytes_requested;
+static uint32_t bytes_sent;
+static uint32_t command_pause_ticks;
+
+// The last byte given to send_byte(), which is held back until we know
+// whether it ends a command (and so needs a longer pause after it)
+static uint8_t held_byte;
+static uint8_t byte_is_held;
+
+// Time (in pause ticks) for the matrix to carry out each command, i.e.
+// how long to pause after the last byte of the command. Updating the
+// whole display and shifting it take the longest.
+static uint8_t command_pause(uint8_t command)
+{
+	if (!PACED)
+	{
+		return 0;
+	}
+	switch (command)
+	{
+		case CMD_UPDATE_ALL:
+			return SPI_PAUSE_TICKS(1000);
+		case CMD_SHIFT_DISPLAY:
+			return SPI_PAUSE_TICKS(500);
+		case CMD_CLEAR_SCREEN:
+			return SPI_PAUSE_TICKS(250);
+		case CMD_UPDATE_ROW: /* FALLTHROUGH */
+		case CMD_UPDATE_COL:
+			return SPI_PAUSE_TICKS(100);
+		default:
+			return BYTE_PAUSE;
+	}
+}
+
+static void send_byte(uint8_t byte)
+{
+	if (byte_is_held)
+	{
+		spi_queue_byte_paced(held_byte, BYTE_PAUSE);
+	}
+	held_byte = byte;
+	byte_is_held = 1;
+	bytes_sent++;
+}
+
+// Send the last byte of a command, followed by the command's pause
+static void end_command(uint8_t command)
+{
+	uint8_t pause = command_pause(command);
+	if (pause > BYTE_PAUSE)
+	{
+		command_pause_ticks += pause - BYTE_PAUSE;
+	}
+	else
+	{
+		pause = BYTE_PAUSE;
+	}
+	spi_queue_byte_paced(held_byte, pause);
+	byte_is_held = 0;
+}
+
+// Set the slave select line of a panel high (deselected) or low
+// (selected). Panel 0 uses the SPI SS pin (B4) and the other panels use
+// pins D2 upwards. Port D is shared with the serial receive interrupt
+// handler (see SERIAL_RTS_BIT in serialio.h), so it is changed with
+// interrupts off.
+static void set_slave_select(uint8_t panel_number, uint8_t high)
+{
+	volatile uint8_t* port = (panel_number == 0) ? &PORTB : &PORTD;
+	uint8_t mask = (panel_number == 0) ? (1 << PORTB4)
+			: (1 << (PORTD2 + panel_number - 1));
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	if (high)
+	{
+		*port |= mask;
+	}
+	else
+	{
+		*port &= ~mask;
+	}
+	if (interrupts_were_enabled)
+	{
+		sei();
+	}
+}
+
+// Make sure the bytes we send next go to the given panel. Must only be
+// called between commands. Anything already queued for another panel has
+// to be sent (and the panel given time to carry it out) before we can
+// switch, so switching panels waits for the SPI queue to empty.
+static void select_bus_panel(uint8_t panel_number)
+{
+	if (panel_number == bus_panel)
+	{
+		return;
+	}
+	spi_flush();
+	set_slave_select(bus_panel, 1);
+	set_slave_select(panel_number, 0);
+	bus_panel = panel_number;
+}
+
+// Check whether a command of the given length fits in what's left of
+// the budget, and if so take it out of the budget
+static uint8_t within_budget(uint16_t cost)
+{
+	if (cost > budget_left)
+	{
+		return 0;
+	}
+	budget_left -= cost;
+	return 1;
+}
+
+// Send the colour of a pending pixel and note that the matrix shows it
+static void send_pending_pixel(uint8_t x, uint8_t y)
+{
+	PaletteIndex index = palette_matrix_column_get(panel->pending[x], y);
+	send_byte(palette_phase_colour(index, dither_phase));
+	palette_matrix_column_set(panel->shown[x], y, index);
+	if (palette_is_dithered(index))
+	{
+		panel->dithered[y] |= (uint16_t)1 << x;
+	}
+	else
+	{
+		panel->dithered[y] &= ~((uint16_t)1 << x);
+	}
+}
+
+static void set_pending_pixel(uint8_t x, uint8_t y, PaletteIndex index)
+{
+	uint16_t bit = (uint16_t)1 << x;
+	palette_matrix_column_set(panel->pending[x], y, index);
+	if (index != palette_matrix_column_get(panel->shown[x], y)
+			|| (panel->stale[y] & bit))
+	{
+		panel->dirty[y] |= bit;
+	}
+	else
+	{
+		panel->dirty[y] &= ~bit;
+	}
+}
+
+static uint8_t count_bits(uint16_t mask)
+{
+	uint8_t count = 0;
+	while (mask)
+	{
+		mask &= mask - 1;
+		count++;
+	}
+	return count;
+}
+
+static void send_pixel(uint8_t x, uint8_t y)
+{
+	uint16_t bit = (uint16_t)1 << x;
+	send_byte(CMD_UPDATE_PIXEL);
+	send_byte(((y & 0x07) << 4) | (x & 0x0F));
+	send_pending_pixel(x, y);
+	end_command(CMD_UPDATE_PIXEL);
+	panel->dirty[y] &= ~bit;
+	panel->stale[y] &= ~bit;
+}
+
+static void send_row(uint8_t y)
+{
+	send_byte(CMD_UPDATE_ROW);
+	send_byte(y & 0x07);	// row number
+	for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++)
+	{
+		send_pending_pixel(x, y);
+	}
+	end_command(CMD_UPDATE_ROW);
+	panel->dirty[y] = 0;
+	panel->stale[y] = 0;
+}
+
+static void send_column(uint8_t x)
+{
+	uint16_t bit = (uint16_t)1 << x;
+	send_byte(CMD_UPDATE_COL);
+	send_byte(x & 0x0F); // column number
+	for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+	{
+		send_pending_pixel(x, y);
+		panel->dirty[y] &= ~bit;
+		panel->stale[y] &= ~bit;
+	}
+	end_command(CMD_UPDATE_COL);
+}
+
+static void send_all(void)
+{
+	send_byte(CMD_UPDATE_ALL);
+	for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+	{
+		for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++)
+		{
+			send_pending_pixel(x, y);
+		}
+		panel->dirty[y] = 0;
+		panel->stale[y] = 0;
+	}
+	end_command(CMD_UPDATE_ALL);
+}
+
+// Cover the pixels in mask with column, row and pixel commands. Columns
+// (or rows) with enough pixels to make a whole column (row) command
+// cheaper are sent that way first, then rows (columns), then whatever is
+// left one pixel at a time. Returns the number of bytes this takes. The
+// commands are only sent if send is non-zero, and then only while they
+// fit in the budget. mask is modified.
+static uint16_t cover_pixels(RowMask mask, uint8_t columns_first, uint8_t send)
+{
+	uint16_t cost = 0;
+	for (uint8_t pass = 0; pass < 2; pass++)
+	{
+		if ((pass == 0) == (columns_first != 0))
+		{
+			for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++)
+			{
+				uint16_t bit = (uint16_t)1 << x;
+				uint8_t count = 0;
+				for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+				{
+					if (mask[y] & bit)
+					{
+						count++;
+					}
+				}
+				if (count * UPDATE_PIXEL_COST > UPDATE_COL_COST)
+				{
+					cost += UPDATE_COL_COST;
+					if (send && within_budget(UPDATE_COL_COST))
+					{
+						send_column(x);
+					}
+					for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+					{
+						mask[y] &= ~bit;
+					}
+				}
+			}
+		}
+		else
+		{
+			for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+			{
+				if (count_bits(mask[y]) * UPDATE_PIXEL_COST > UPDATE_ROW_COST)
+				{
+					cost += UPDATE_ROW_COST;
+					if (send && within_budget(UPDATE_ROW_COST))
+					{
+						send_row(y);
+					}
+					mask[y] = 0;
+				}
+			}
+		}
+	}
+	for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+	{
+		for (uint8_t x = 0; mask[y] != 0; x++)
+		{
+			uint16_t bit = (uint16_t)1 << x;
+			if (mask[y] & bit)
+			{
+				mask[y] &= ~bit;
+				cost += UPDATE_PIXEL_COST;
+				if (send && within_budget(UPDATE_PIXEL_COST))
+				{
+					send_pixel(x, y);
+				}
+			}
+		}
+	}
+	return cost;
+}
+
+static void copy_mask(RowMask from, RowMask to)
+{
+	for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+	{
+		to[y] = from[y];
+	}
+}
+
+// Work out the cheapest way of covering mask with column/row/pixel
+// commands. Returns the cost and sets *columns_first to the order to use.
+static uint16_t cheapest_cover(RowMask mask, uint8_t* columns_first)
+{
+	RowMask scratch;
+	copy_mask(mask, scratch);
+	uint16_t rows_first_cost = cover_pixels(scratch, 0, 0);
+	copy_mask(mask, scratch);
+	uint16_t columns_first_cost = cover_pixels(scratch, 1, 0);
+	*columns_first = (columns_first_cost < rows_first_cost);
+	return *columns_first ? columns_first_cost : rows_first_cost;
+}
+
+// Send the dirty pixels of the panel we're working on (panel_number)
+// using the cheapest combination of commands, sending no more than
+// budget_left bytes. Pixels that don't fit in the budget are left dirty.
+// If dithered_only is non-zero only the dirty pixels showing dithered
+// entries are sent (and the whole display is never sent or cleared).
+static void send_dirty_panel_pixels(uint8_t panel_number,
+		uint8_t dithered_only)
+{
+	RowMask to_send;
+	uint16_t num_dirty = 0;
+	for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+	{
+		to_send[y] = panel->dirty[y];
+		if (dithered_only)
+		{
+			to_send[y] &= panel->dithered[y];
+		}
+		num_dirty += count_bits(to_send[y]);
+	}
+	if (num_dirty == 0)
+	{
+		return;
+	}
+	select_bus_panel(panel_number);
+	
+	// A few pixels are always cheapest to send one at a time
+	if (num_dirty * UPDATE_PIXEL_COST <= UPDATE_COL_COST)
+	{
+		for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+		{
+			for (uint8_t x = 0; to_send[y] != 0; x++)
+			{
+				uint16_t bit = (uint16_t)1 << x;
+				if ((to_send[y] & bit) && within_budget(UPDATE_PIXEL_COST))
+				{
+					send_pixel(x, y);
+				}
+				to_send[y] &= ~bit;
+			}
+		}
+		return;
+	}
+	
+	uint8_t columns_first;
+	uint16_t best_cost = cheapest_cover(to_send, &columns_first);
+	if (dithered_only)
+	{
+		(void)cover_pixels(to_send, columns_first, 1);
+		return;
+	}
+	
+	// Clearing the screen first helps if most of the changes are to black
+	RowMask non_black;
+	uint8_t clear_columns_first = 0;
+	uint16_t clear_cost = UINT16_MAX;
+	if (best_cost > CLEAR_SCREEN_COST + UPDATE_PIXEL_COST)
+	{
+		for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+		{
+			non_black[y] = 0;
+			for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++)
+			{
+				if (palette_matrix_column_get(panel->pending[x], y) != PALETTE_BLACK)
+				{
+					non_black[y] |= (uint16_t)1 << x;
+				}
+			}
+		}
+		clear_cost = CLEAR_SCREEN_COST
+				+ cheapest_cover(non_black, &clear_columns_first);
+	}
+	
+	if (UPDATE_ALL_COST <= best_cost && UPDATE_ALL_COST <= clear_cost
+			&& within_budget(UPDATE_ALL_COST))
+	{
+		send_all();
+	}
+	else if (clear_cost < best_cost && clear_cost <= budget_left)
+	{
+		// Only worth it if the pixels redrawn after the clear fit in the
+		// budget too - otherwise they'd stay black until the next batch
+		budget_left -= CLEAR_SCREEN_COST;
+		send_byte(CMD_CLEAR_SCREEN);
+		end_command(CMD_CLEAR_SCREEN);
+		for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++)
+		{
+			set_palette_matrix_column_to_index(panel->shown[x], PALETTE_BLACK);
+		}
+		for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+		{
+			panel->dirty[y] = non_black[y];
+			panel->stale[y] = 0;
+			panel->dithered[y] = 0;
+		}
+		(void)cover_pixels(non_black, clear_columns_first, 1);
+	}
+	else
+	{
+		(void)cover_pixels(to_send, columns_first, 1);
+	}
+}
+
+// Send the dirty pixels (or only the dithered ones, see above) of every
+// panel, sending no more than budget bytes altogether
+static void send_dirty_pixels(uint16_t budget, uint8_t dithered_only)
+{
+	budget_left = budget;
+	for (uint8_t i = 0; i < LEDMATRIX_NUM_PANELS; i++)
+	{
+		uint8_t panel_number = first_panel_to_send + i;
+		if (panel_number >= LEDMATRIX_NUM_PANELS)
+		{
+			panel_number -= LEDMATRIX_NUM_PANELS;
+		}
+		panel = &panels[panel_number];
+		send_dirty_panel_pixels(panel_number, dithered_only);
+	}
+	if (++first_panel_to_send >= LEDMATRIX_NUM_PANELS)
+	{
+		first_panel_to_send = 0;
+	}
+	panel = &panels[selected_panel];
+}
+
+// Called after every update - sends the changes unless we're in a batch
+static void update_done(uint16_t request_cost)
+{
+	bytes_requested += request_cost;
+	if (batch_depth == 0)
+	{
+		send_dirty_pixels(UINT16_MAX, 0);
+	}
+}
+
 void ledmatrix_setup(void)
 {
-	// Setup SPI - we divide the clock by 128.
-	// (This speed guarantees the SPI buffer will never overflow on
-	// the LED matrix.)
-	spi_setup_master(128);
+	// Setup SPI. Dividing the clock by 128 guarantees the SPI buffer
+	// will never overflow on the LED matrix. At the faster speeds we
+	// pause between commands instead (see command_pause()).
+	// This selects panel 0 (SS low).
+	spi_setup_master(LEDMATRIX_SPI_DIVIDER);
+	bus_panel = 0;
+	
+	// The slave select lines of the other panels are outputs and start
+	// high (deselected)
+	for (uint8_t panel_number = 1; panel_number < LEDMATRIX_NUM_PANELS;
+			panel_number++)
+	{
+		DDRD |= (1 << (PORTD2 + panel_number - 1));
+		set_slave_select(panel_number, 1);
+	}
+	
+	// Start from a known (blank) display on every panel
+	batch_depth = 0;
+	byte_is_held = 0;
+	for (uint8_t panel_number = 0; panel_number < LEDMATRIX_NUM_PANELS;
+			panel_number++)
+	{
+		panel = &panels[panel_number];
+		select_bus_panel(panel_number);
+		send_byte(CMD_CLEAR_SCREEN);
+		end_command(CMD_CLEAR_SCREEN);
+		for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++)
+		{
+			set_palette_matrix_column_to_index(panel->shown[x], PALETTE_BLACK);
+			set_palette_matrix_column_to_index(panel->pending[x],
+					PALETTE_BLACK);
+		}
+		for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+		{
+			panel->dirty[y] = 0;
+			panel->stale[y] = 0;
+			panel->dithered[y] = 0;
+		}
+	}
+	dither_phase = 0;
+	first_panel_to_send = 0;
+	ledmatrix_select_panel(0);
+	ledmatrix_reset_stats();
+}
+
+void ledmatrix_select_panel(uint8_t panel_number)
+{
+	if (panel_number >= LEDMATRIX_NUM_PANELS)
+	{
+		// Panel number isn't valid - we ignore the request.
+		return;
+	}
+	selected_panel = panel_number;
+	panel = &panels[panel_number];
+}
+
+uint8_t ledmatrix_selected_panel(void)
+{
+	return selected_panel;
+}
+
+void ledmatrix_begin_batch(void)
+{
+	batch_depth++;
+}
+
+void ledmatrix_end_batch(void)
+{
+	ledmatrix_end_batch_limited(UINT16_MAX);
+}
+
+void ledmatrix_end_batch_limited(uint16_t max_bytes)
+{
+	if (batch_depth > 0 && --batch_depth == 0)
+	{
+		send_dirty_pixels(max_bytes, 0);
+	}
+}
+
+void ledmatrix_flush(void)
+{
+	spi_flush();
+}
+
+void ledmatrix_set_dither_phase(uint8_t phase)
+{
+	phase &= 1;
+	if (phase == dither_phase)
+	{
+		return;
+	}
+	dither_phase = phase;
+	// Pixels showing dithered entries now show the wrong colour
+	for (uint8_t panel_number = 0; panel_number < LEDMATRIX_NUM_PANELS;
+			panel_number++)
+	{
+		for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+		{
+			panels[panel_number].dirty[y] |= panels[panel_number].dithered[y];
+			panels[panel_number].stale[y] |= panels[panel_number].dithered[y];
+		}
+	}
+}
+
+uint8_t ledmatrix_showing_dithered(void)
+{
+	for (uint8_t panel_number = 0; panel_number < LEDMATRIX_NUM_PANELS;
+			panel_number++)
+	{
+		for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+		{
+			if (panels[panel_number].dithered[y])
+			{
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+void ledmatrix_send_dithered(uint16_t max_bytes)
+{
+	if (batch_depth == 0)
+	{
+		send_dirty_pixels(max_bytes, 1);
+	}
+}
+
+uint8_t ledmatrix_byte_period_us(void)
+{
+	if (PACED && BYTE_TIME_US < MIN_BYTE_SPACING_US)
+	{
+		return MIN_BYTE_SPACING_US;
+	}
+	return BYTE_TIME_US;
+}
+
+uint32_t ledmatrix_bytes_requested(void)
+{
+	return bytes_requested;
+}
+
+uint32_t ledmatrix_bytes_sent(void)
+{
+	return bytes_sent;
+}
+
+uint32_t ledmatrix_command_pause_ticks(void)
+{
+	return command_pause_ticks;
+}
+
+uint32_t ledmatrix_bytes_saved(void)
+{
+	return bytes_requested - bytes_sent;
+}
+
+void ledmatrix_reset_stats(void)
+{
+	bytes_requested = 0;
+	bytes_sent = 0;
+	command_pause_ticks = 0;
 }
 
 void ledmatrix_update_all(MatrixData data)
 {
-	(void)spi_send_byte(CMD_UPDATE_ALL);
 	for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
 	{
 		for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++)
 		{
-			(void)spi_send_byte(data[x][y]);
+			set_pending_pixel(x, y, palette_index(data[x][y]));
 		}
 	}
+	update_done(UPDATE_ALL_COST);
+}
+
+void ledmatrix_update_all_palette(PaletteMatrixData data)
+{
+	for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++)
+	{
+		for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+		{
+			set_pending_pixel(x, y, palette_matrix_column_get(data[x], y));
+		}
+	}
+	update_done(UPDATE_ALL_COST);
 }
 
 void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel)
+{
+	ledmatrix_update_pixel_index(x, y, palette_index(pixel));
+}
+
+void ledmatrix_update_pixel_index(uint8_t x, uint8_t y, PaletteIndex index)
 {
 	if (x >= MATRIX_NUM_COLUMNS || y >= MATRIX_NUM_ROWS)
 	{
 		// Position isn't valid - we ignore the request.
 		return;
 	}
-	(void)spi_send_byte(CMD_UPDATE_PIXEL);
-	(void)spi_send_byte(((y & 0x07) << 4) | (x & 0x0F));
-	(void)spi_send_byte(pixel);
+	set_pending_pixel(x, y, index);
+	update_done(UPDATE_PIXEL_COST);
 }
 
 void ledmatrix_draw_pixel_in_human_grid(uint8_t x, uint8_t y, PixelColour pixel)
+{
+	ledmatrix_draw_pixel_index_in_human_grid(x, y, palette_index(pixel));
+}
+
+void ledmatrix_draw_pixel_in_computer_grid(uint8_t x, uint8_t y, PixelColour pixel)
+{
+	ledmatrix_draw_pixel_index_in_computer_grid(x, y, palette_index(pixel));
+}
+
+void ledmatrix_draw_pixel_index_in_human_grid(uint8_t x, uint8_t y,
+		PaletteIndex index)
 {
 	if (x >= GRID_NUM_COLUMNS || y >= GRID_NUM_ROWS)
 	{
 		// Position isn't valid - we ignore the request.
 		return;
 	}
-	ledmatrix_update_pixel(x, y, pixel);
+	uint8_t previous_panel = selected_panel;
+	ledmatrix_select_panel(HUMAN_GRID_PANEL);
+	ledmatrix_update_pixel_index(x + HUMAN_GRID_X_OFFSET, y, index);
+	ledmatrix_select_panel(previous_panel);
 }
 
-void ledmatrix_draw_pixel_in_computer_grid(uint8_t x, uint8_t y, PixelColour pixel)
+void ledmatrix_draw_pixel_index_in_computer_grid(uint8_t x, uint8_t y,
+		PaletteIndex index)
 {
 	if (x >= GRID_NUM_COLUMNS || y >= GRID_NUM_ROWS)
 	{
 		// Position isn't valid - we ignore the request.
 		return;
 	}
-	ledmatrix_update_pixel(x+GRID_NUM_COLUMNS, y, pixel);
+	uint8_t previous_panel = selected_panel;
+	ledmatrix_select_panel(COMPUTER_GRID_PANEL);
+	ledmatrix_update_pixel_index(x + COMPUTER_GRID_X_OFFSET, y, index);
+	ledmatrix_select_panel(previous_panel);
 }
 
 void ledmatrix_update_row(uint8_t y, MatrixRow row)
@@ -77,12 +807,11 @@ void ledmatrix_update_row(uint8_t y, MatrixRow row)
 		// y value is too large - we ignore the request
 		return;
 	}
-	(void)spi_send_byte(CMD_UPDATE_ROW);
-	(void)spi_send_byte(y & 0x07);	// row number
 	for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++)
 	{
-		(void)spi_send_byte(row[x]);
+		set_pending_pixel(x, y, palette_index(row[x]));
 	}
+	update_done(UPDATE_ROW_COST);
 }
 
 void ledmatrix_update_column(uint8_t x, MatrixColumn col)
@@ -92,41 +821,134 @@ void ledmatrix_update_column(uint8_t x, MatrixColumn col)
 		// x value is too large - we ignore the request
 		return;
 	}
-	(void)spi_send_byte(CMD_UPDATE_COL);
-	(void)spi_send_byte(x & 0x0F); // column number
 	for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
 	{
-		(void)spi_send_byte(col[y]);
+		set_pending_pixel(x, y, palette_index(col[y]));
+	}
+	update_done(UPDATE_COL_COST);
+}
+
+void ledmatrix_update_column_palette(uint8_t x, PaletteMatrixColumn col)
+{
+	if (x >= MATRIX_NUM_COLUMNS)
+	{
+		// x value is too large - we ignore the request
+		return;
+	}
+	for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+	{
+		set_pending_pixel(x, y, palette_matrix_column_get(col, y));
+	}
+	update_done(UPDATE_COL_COST);
+}
+
+// The shift commands are sent straight away. Our copies of the display
+// are shifted to match. We don't rely on what the matrix puts in the
+// row or column that is shifted in - it is treated as stale (and
+// pending black) until it is next written.
+static void shift_display(uint8_t direction)
+{
+	bytes_requested += SHIFT_DISPLAY_COST;
+	select_bus_panel(selected_panel);
+	send_byte(CMD_SHIFT_DISPLAY);
+	send_byte(direction);
+	end_command(CMD_SHIFT_DISPLAY);
+}
+
+static void shift_columns(int8_t dx)
+{
+	uint8_t edge = (dx < 0) ? MATRIX_NUM_COLUMNS - 1 : 0;
+	for (uint8_t i = 0; i < MATRIX_NUM_COLUMNS - 1; i++)
+	{
+		// Walk in the opposite direction to the shift so that we
+		// read each column before it is overwritten
+		uint8_t to = (dx < 0) ? i : MATRIX_NUM_COLUMNS - 1 - i;
+		copy_palette_matrix_column(panel->shown[to - dx], panel->shown[to]);
+		copy_palette_matrix_column(panel->pending[to - dx], panel->pending[to]);
+	}
+	set_palette_matrix_column_to_index(panel->shown[edge], PALETTE_BLACK);
+	set_palette_matrix_column_to_index(panel->pending[edge], PALETTE_BLACK);
+	for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+	{
+		if (dx < 0)
+		{
+			panel->dirty[y] >>= 1;
+			panel->stale[y] >>= 1;
+			panel->dithered[y] >>= 1;
+		}
+		else
+		{
+			panel->dirty[y] <<= 1;
+			panel->stale[y] <<= 1;
+			panel->dithered[y] <<= 1;
+		}
+		panel->dirty[y] |= (uint16_t)1 << edge;
+		panel->stale[y] |= (uint16_t)1 << edge;
+		panel->dithered[y] &= ~((uint16_t)1 << edge);
 	}
 }
 
+static void shift_rows(int8_t dy)
+{
+	uint8_t edge = (dy < 0) ? MATRIX_NUM_ROWS - 1 : 0;
+	for (uint8_t i = 0; i < MATRIX_NUM_ROWS - 1; i++)
+	{
+		uint8_t to = (dy < 0) ? i : MATRIX_NUM_ROWS - 1 - i;
+		for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++)
+		{
+			palette_matrix_column_set(panel->shown[x], to,
+					palette_matrix_column_get(panel->shown[x], to - dy));
+			palette_matrix_column_set(panel->pending[x], to,
+					palette_matrix_column_get(panel->pending[x], to - dy));
+		}
+		panel->dirty[to] = panel->dirty[to - dy];
+		panel->stale[to] = panel->stale[to - dy];
+		panel->dithered[to] = panel->dithered[to - dy];
+	}
+	for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++)
+	{
+		palette_matrix_column_set(panel->shown[x], edge, PALETTE_BLACK);
+		palette_matrix_column_set(panel->pending[x], edge, PALETTE_BLACK);
+	}
+	panel->dirty[edge] = ALL_COLUMNS;
+	panel->stale[edge] = ALL_COLUMNS;
+	panel->dithered[edge] = 0;
+}
+
 void ledmatrix_shift_display_left(void)
 {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x02);
+	shift_display(0x02);
+	shift_columns(-1);
 }
 
 void ledmatrix_shift_display_right(void)
 {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x01);
+	shift_display(0x01);
+	shift_columns(1);
 }
 
 void ledmatrix_shift_display_up(void)
 {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x08);
+	shift_display(0x08);
+	shift_rows(1);
 }
 
 void ledmatrix_shift_display_down(void)
 {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x04);
+	shift_display(0x04);
+	shift_rows(-1);
 }
 
 void ledmatrix_clear(void)
 {
-	(void)spi_send_byte(CMD_CLEAR_SCREEN);
+	for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+	{
+		for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++)
+		{
+			set_pending_pixel(x, y, PALETTE_BLACK);
+		}
+	}
+	update_done(CLEAR_SCREEN_COST);
 }
 
 void copy_matrix_column(MatrixColumn from, MatrixColumn to)
@@ -162,3 +984,42 @@ void set_matrix_row_to_colour(MatrixRow matrix_row, PixelColour colour)
 		matrix_row[column] = colour;
 	}
 }
+
+PaletteIndex palette_matrix_column_get(PaletteMatrixColumn column, uint8_t y)
+{
+	uint8_t pair = column[y >> 1];
+	return (y & 1) ? (pair >> 4) : (pair & 0x0F);
+}
+
+void palette_matrix_column_set(PaletteMatrixColumn column, uint8_t y,
+		PaletteIndex index)
+{
+	uint8_t* pair = &column[y >> 1];
+	if (y & 1)
+	{
+		*pair = (*pair & 0x0F) | (index << 4);
+	}
+	else
+	{
+		*pair = (*pair & 0xF0) | (index & 0x0F);
+	}
+}
+
+void copy_palette_matrix_column(PaletteMatrixColumn from,
+		PaletteMatrixColumn to)
+{
+	for (uint8_t i = 0; i < PALETTE_MATRIX_COLUMN_BYTES; i++)
+	{
+		to[i] = from[i];
+	}
+}
+
+void set_palette_matrix_column_to_index(PaletteMatrixColumn column,
+		PaletteIndex index)
+{
+	uint8_t pair = (index & 0x0F) | (index << 4);
+	for (uint8_t i = 0; i < PALETTE_MATRIX_COLUMN_BYTES; i++)
+	{
+		column[i] = pair;
+	}
+}
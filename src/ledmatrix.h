@@ -9,6 +9,7 @@
 
 #include <stdint.h>
 #include "pixel_colour.h"
+#include "palette.h"
 
 // The matrix has 16 columns (x ranges from 0 to 15, left to right) and
 // 8 rows (y ranges from 0 to 7, bottom to top) - as per the X,Y
@@ -19,31 +20,129 @@
 #define GRID_NUM_COLUMNS 8
 #define GRID_NUM_ROWS 8
 
+// Number of matrix panels on the SPI bus (1 to 7). Each panel has its own
+// slave select line - panel 0 uses the SPI SS pin (B4) and panel n uses
+// pin D(n+1). With more than one panel each player has a panel of their
+// own - the computer's grid is shown on panel 1, at the left like the
+// human's grid on panel 0.
+#ifndef LEDMATRIX_NUM_PANELS
+#define LEDMATRIX_NUM_PANELS 1
+#endif
+#define HUMAN_GRID_PANEL 0
+#define HUMAN_GRID_X_OFFSET 0
+#if LEDMATRIX_NUM_PANELS > 1
+#define COMPUTER_GRID_PANEL 1
+#define COMPUTER_GRID_X_OFFSET 0
+#else
+#define COMPUTER_GRID_PANEL 0
+#define COMPUTER_GRID_X_OFFSET GRID_NUM_COLUMNS
+#endif
+
+// SPI clock divider used to talk to the matrix - 8, 16, 32 or 128.
+// At 128 the matrix can always keep up. The faster speeds pause after
+// each command to give the matrix time to carry it out (see ledmatrix.c),
+// but the pause lengths are estimates which haven't been measured on the
+// matrix, so they must be asked for (e.g. -DLEDMATRIX_SPI_DIVIDER=32).
+#ifndef LEDMATRIX_SPI_DIVIDER
+#define LEDMATRIX_SPI_DIVIDER 128
+#endif
+
 // Data types which can be used to store display information
 typedef PixelColour MatrixData[MATRIX_NUM_COLUMNS][MATRIX_NUM_ROWS];
 typedef PixelColour MatrixRow[MATRIX_NUM_COLUMNS];
 typedef PixelColour MatrixColumn[MATRIX_NUM_ROWS];
 
+// Palette indexed versions of the above (see palette.h) which take half the
+// memory. Each byte holds two vertically adjacent pixels - the even row
+// in the low nibble and the odd row in the high nibble. Use the
+// palette_matrix_ functions below to get at the pixels.
+#define PALETTE_MATRIX_COLUMN_BYTES (MATRIX_NUM_ROWS / 2)
+typedef uint8_t PaletteMatrixColumn[PALETTE_MATRIX_COLUMN_BYTES];
+typedef PaletteMatrixColumn PaletteMatrixData[MATRIX_NUM_COLUMNS];
+
 // Setup SPI communication with the LED matrix.
 // This function must be called before the LED matrix functions
 // below are used.
 void ledmatrix_setup(void);
 
+// Choose the panel that the functions below update (panel 0 after
+// setup). Invalid panel numbers are ignored. The grid drawing functions
+// choose their own panel.
+void ledmatrix_select_panel(uint8_t panel_number);
+uint8_t ledmatrix_selected_panel(void);
+
 // Functions to update the display
 // For those functions which take an x or a y value, the value must be valid
 // or the request will be ignored. (i.e. x must be < MATRIX_NUM_COLUMNS
 // and y must be < MATRIX_NUM_ROWS)
+// Commands are queued and sent in the background so these functions
+// return straight away. ledmatrix_flush() waits until everything queued
+// so far has reached the matrix.
+// Pixels that already have the requested colour are not sent again.
+// Updates made between ledmatrix_begin_batch() and ledmatrix_end_batch()
+// are held back and sent together when the batch ends, using whichever
+// combination of pixel/row/column/all/clear commands is shortest.
+// Batches may be nested - only the outermost end sends the updates.
+// Only panels with changes are sent anything. Sending to a different
+// panel from last time waits for the SPI queue to empty first.
+// ledmatrix_end_batch_limited() sends at most max_bytes (which should be
+// at least 18, the length of a row command); anything that doesn't fit
+// is sent by the next batch or update.
+// The shift functions are always sent immediately.
+// The matrix contents are kept as palette indices, so colours which aren't
+// in the palette are shown as the closest palette colour. The _index and
+// _palette versions take palette indices directly, which saves looking
+// the colours up.
 void ledmatrix_update_all(MatrixData data);
+void ledmatrix_update_all_palette(PaletteMatrixData data);
 void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel);
+void ledmatrix_update_pixel_index(uint8_t x, uint8_t y, PaletteIndex index);
 void ledmatrix_draw_pixel_in_human_grid(uint8_t x, uint8_t y, PixelColour pixel);
 void ledmatrix_draw_pixel_in_computer_grid(uint8_t x, uint8_t y, PixelColour pixel);
+void ledmatrix_draw_pixel_index_in_human_grid(uint8_t x, uint8_t y,
+		PaletteIndex index);
+void ledmatrix_draw_pixel_index_in_computer_grid(uint8_t x, uint8_t y,
+		PaletteIndex index);
 void ledmatrix_update_row(uint8_t y, MatrixRow row);
 void ledmatrix_update_column(uint8_t x, MatrixColumn col);
+void ledmatrix_update_column_palette(uint8_t x, PaletteMatrixColumn col);
 void ledmatrix_shift_display_left(void);
 void ledmatrix_shift_display_right(void);
 void ledmatrix_shift_display_up(void);
 void ledmatrix_shift_display_down(void);
 void ledmatrix_clear(void);
+void ledmatrix_flush(void);
+void ledmatrix_begin_batch(void);
+void ledmatrix_end_batch(void);
+void ledmatrix_end_batch_limited(uint16_t max_bytes);
+
+// Set the dithering phase (0 or 1) - see palette.h and dither.h. Pixels
+// showing dithered palette entries are marked as needing to be resent,
+// which happens with the next batch or update.
+void ledmatrix_set_dither_phase(uint8_t phase);
+
+// Return non-zero if any pixel is showing a dithered palette entry
+uint8_t ledmatrix_showing_dithered(void);
+
+// Send the pixels showing dithered palette entries which need resending,
+// at most max_bytes (at least 18, as above). Other changes are left for
+// the next batch or update. Does nothing inside a batch.
+void ledmatrix_send_dithered(uint16_t max_bytes);
+
+// Shortest time between bytes sent to the matrix (us)
+uint8_t ledmatrix_byte_period_us(void);
+
+// Statistics on SPI traffic since setup (or the last reset).
+// bytes_requested is what the update calls above would have sent
+// without redundant write suppression and coalescing, bytes_sent is
+// what was actually sent and bytes_saved is the difference.
+// command_pause_ticks is the time spent pausing after commands (see
+// spi.h for the units) on top of ledmatrix_byte_period_us() per byte.
+uint32_t ledmatrix_bytes_requested(void);
+uint32_t ledmatrix_bytes_sent(void);
+uint32_t ledmatrix_bytes_saved(void);
+uint32_t ledmatrix_command_pause_ticks(void);
+void ledmatrix_reset_stats(void);
 
 // Functions to operate on MatrixRow and MatrixColumn data structures
 void copy_matrix_column(MatrixColumn from, MatrixColumn to);
@@ -51,4 +150,13 @@ void copy_matrix_row(MatrixRow from, MatrixRow to);
 void set_matrix_column_to_colour(MatrixColumn matrix_column, PixelColour colour);
 void set_matrix_row_to_colour(MatrixRow matrix_row, PixelColour colour);
 
+// Functions to operate on PaletteMatrixData and PaletteMatrixColumn
+PaletteIndex palette_matrix_column_get(PaletteMatrixColumn column, uint8_t y);
+void palette_matrix_column_set(PaletteMatrixColumn column, uint8_t y,
+		PaletteIndex index);
+void copy_palette_matrix_column(PaletteMatrixColumn from,
+		PaletteMatrixColumn to);
+void set_palette_matrix_column_to_index(PaletteMatrixColumn column,
+		PaletteIndex index);
+
 #endif /* LEDMATRIX_H_ */
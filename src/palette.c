@@ -0,0 +1,71 @@
+/*
+ * palette.c
+ *
+ * The colour palette used for 4 bit (palette indexed) pixels.
+ */
+
+#include "palette.h"
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+// Colours in the same order as the PALETTE_ entries in palette.h, for
+// each dithering phase. Only the dithered entries differ between phases.
+static const PixelColour palette[2][PALETTE_SIZE] PROGMEM =
+{
+	{
+		COLOUR_BLACK, COLOUR_RED, COLOUR_GREEN, COLOUR_ORANGE,
+		COLOUR_YELLOW, COLOUR_DARK_YELLOW, COLOUR_DARK_RED,
+		COLOUR_DARK_GREEN, COLOUR_DARK_ORANGE,
+		0x07, 0x70, 0x77,
+		0x01, 0x10, 0x11, 0x14
+	},
+	{
+		COLOUR_BLACK, COLOUR_RED, COLOUR_GREEN, COLOUR_ORANGE,
+		COLOUR_YELLOW, COLOUR_DARK_YELLOW, COLOUR_DARK_RED,
+		COLOUR_DARK_GREEN, COLOUR_DARK_ORANGE,
+		0x07, 0x70, 0x77,
+		0x02, 0x20, 0x22, 0x25
+	}
+};
+
+PixelColour palette_colour(PaletteIndex index)
+{
+	return palette_phase_colour(index, 0);
+}
+
+PixelColour palette_phase_colour(PaletteIndex index, uint8_t phase)
+{
+	return pgm_read_byte(&palette[phase & 1][index & (PALETTE_SIZE - 1)]);
+}
+
+// Difference between two 4 bit colour components
+static uint8_t component_distance(uint8_t a, uint8_t b)
+{
+	return (a > b) ? a - b : b - a;
+}
+
+PaletteIndex palette_index(PixelColour colour)
+{
+	PaletteIndex best = PALETTE_BLACK;
+	uint8_t best_distance = UINT8_MAX;
+	for (PaletteIndex i = 0; i < PALETTE_SIZE; i++)
+	{
+		if (palette_is_dithered(i))
+		{
+			continue;
+		}
+		PixelColour entry = pgm_read_byte(&palette[0][i]);
+		uint8_t distance = component_distance(entry >> 4, colour >> 4)
+				+ component_distance(entry & 0x0F, colour & 0x0F);
+		if (distance < best_distance)
+		{
+			best = i;
+			best_distance = distance;
+			if (distance == 0)
+			{
+				break;
+			}
+		}
+	}
+	return best;
+}
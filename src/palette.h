@@ -0,0 +1,61 @@
+/*
+ * palette.h
+ *
+ * A palette of (at most) 16 colours kept in flash, so that a pixel can be
+ * stored as a 4 bit palette index rather than an 8 bit PixelColour.
+ * PaletteMatrixData (see ledmatrix.h) stores two pixels per byte and so
+ * takes half the memory of MatrixData.
+ *
+ * Some entries are dithered - they alternate between two colours on
+ * successive sub-frames (see dither.h), which looks like a shade in
+ * between. Dithered entries are only shown that way while dithering is
+ * running - otherwise their first colour is shown.
+ */
+
+#ifndef PALETTE_H_
+#define PALETTE_H_
+
+#include <stdint.h>
+#include "pixel_colour.h"
+
+#define PALETTE_SIZE 16
+
+typedef uint8_t PaletteIndex;
+
+// Palette entries. The first entries are the colours in pixel_colour.h.
+#define PALETTE_BLACK			(0)
+#define PALETTE_RED				(1)
+#define PALETTE_GREEN			(2)
+#define PALETTE_ORANGE			(3)
+#define PALETTE_YELLOW			(4)
+#define PALETTE_DARK_YELLOW		(5)
+#define PALETTE_DARK_RED		(6)
+#define PALETTE_DARK_GREEN		(7)
+#define PALETTE_DARK_ORANGE		(8)
+// Half brightness red, green and yellow
+#define PALETTE_MID_RED			(9)
+#define PALETTE_MID_GREEN		(10)
+#define PALETTE_MID_YELLOW		(11)
+// Dithered entries - slightly brighter than the dark colours, and
+// easier to tell apart from them
+#define PALETTE_DITHER_DARK_RED		(12)
+#define PALETTE_DITHER_DARK_GREEN	(13)
+#define PALETTE_DITHER_DARK_YELLOW	(14)
+#define PALETTE_DITHER_DARK_ORANGE	(15)
+
+// Bit i is set if palette entry i is dithered
+#define PALETTE_DITHERED_MASK ((uint16_t)0xF000)
+#define palette_is_dithered(index) ((PALETTE_DITHERED_MASK >> (index)) & 1)
+
+// Return the colour of a palette entry (its first colour if dithered)
+PixelColour palette_colour(PaletteIndex index);
+
+// Return the colour of a palette entry in the given dithering phase
+// (0 or 1). Entries which aren't dithered are the same in both phases.
+PixelColour palette_phase_colour(PaletteIndex index, uint8_t phase);
+
+// Return the palette entry for a colour. Colours which aren't in the
+// palette are given the closest entry which isn't dithered.
+PaletteIndex palette_index(PixelColour colour);
+
+#endif /* PALETTE_H_ */
@@ -7,7 +7,6 @@
  * Modified by Ian Pinto
  */
 
-#include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <stdint.h>
@@ -15,15 +14,25 @@
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
 
-#define F_CPU 8000000UL
+#include "clock.h"
 #include <util/delay.h>
 
 #include "game.h"
 #include "display.h"
 #include "ledmatrix.h"
+#include "render.h"
+#include "dither.h"
+#include "cell_colour.h"
 #include "buttons.h"
 #include "serialio.h"
 #include "terminalio.h"
+#include "fmt.h"
+#include "telemetry.h"
+#include "battle_log.h"
+#include "board_view.h"
+#include "banner.h"
+#include "events.h"
+#include "joystick.h"
 #include "timer0.h"
 #include "timer1.h"
 #include "timer2.h"
@@ -37,10 +46,14 @@ void play_game(void);
 void handle_game_over(void);
 
 void show_salvo_mode_terminal();
+void show_colour_theme_terminal();
 
 // Last time the cursor was flashed
 volatile uint32_t last_flash_time;
 
+// Last time a frame was drawn on the LED matrix
+uint32_t last_frame_time;
+
 /////////////////////////////// main //////////////////////////////////
 int main(void)
 {
@@ -68,48 +81,56 @@ int main(void)
 void initialise_hardware(void)
 {
     ledmatrix_setup();
-    init_button_interrupts();
-    // Setup serial port for 19200 baud communication with no echo
-    // of incoming characters
-    init_serial_stdio(19200, 0);
+    events_init();
+    init_buttons();
+    // Setup serial port (at SERIAL_BAUD) with no echo of incoming
+    // characters, which go to the input event queue
+    init_serial_stdio(0);
+    serial_set_input_events(1);
+    telemetry_init();
 
     init_timer0();
     init_timer1();
     init_timer2();
+    dither_init();
+    init_joystick();
 
     // Turn on global interrupts
     sei();
 
     // Prepare port C for output (leds)
     DDRC = 0b00111111;
-
-    // Set up ADC for joystick
-    ADMUX = (1 << REFS0);
-    ADCSRA = (1 << ADEN) | (1 << ADPS2) | (1 << ADPS1);
 }
 
-// Get serial input if available, otherwise return -1
-char get_serial_input()
+/**
+ * @brief 1 if an input event is a button being pressed (not released,
+ * held or repeating)
+ */
+uint8_t is_button_press(const Event* event)
 {
-    char serial_input = -1;
-    if (serial_input_available())
-    {
-        serial_input = fgetc(stdin);
-    }
-    return serial_input;
+    return event->source == EVENT_BUTTON
+        && BUTTON_ACTION(event->code) == BUTTON_PRESS;
 }
 
 /**
- * @brief Get the serial input in lowercase, or -1 if unavailable
+ * @brief The key an input event stands for, in lowercase. Button presses
+ * and repeats (while held) stand for the keys which do the same thing (d,
+ * s, w and a). 0 for the joystick and other button events.
  */
-char get_serial_input_lower()
+char event_key(const Event* event)
 {
-    char c = get_serial_input();
-    if (c == -1)
+    static const char button_keys[NUM_BUTTONS] PROGMEM = {'d', 's', 'w', 'a'};
+    if (event->source == EVENT_SERIAL)
     {
-        return c;
+        return tolower(event->code);
     }
-    return tolower(c);
+    if (event->source == EVENT_BUTTON
+        && (BUTTON_ACTION(event->code) == BUTTON_PRESS
+            || BUTTON_ACTION(event->code) == BUTTON_REPEAT))
+    {
+        return pgm_read_byte(&button_keys[BUTTON_NUMBER(event->code)]);
+    }
+    return 0;
 }
 
 /**
@@ -117,122 +138,139 @@ char get_serial_input_lower()
  */
 void show_salvo_mode_terminal()
 {
-    move_terminal_cursor(0, 18);
+    set_terminal_line_P(0, 18,
+        (salvo_mode ? PSTR("Salvo mode: on") : PSTR("Salvo mode: off")));
+}
+
+#ifdef DITHER_STATS
+/**
+ * @brief Show the cost of dithering on the terminal, once a second
+ */
+void show_dither_stats_terminal()
+{
+    static uint32_t last_stats_time;
+    uint32_t current_time = get_current_time();
+    if (current_time - last_stats_time < 1000)
+    {
+        return;
+    }
+    last_stats_time = current_time;
+    move_terminal_cursor(0, 21);
     clear_to_end_of_line();
-    printf(
-        "Salvo mode: %s",
-        (salvo_mode ? "on" : "off"));
+    fmt_string_P(PSTR("Dithering: CPU "));
+    fmt_u8(dither_cpu_percent());
+    fmt_string_P(PSTR("%, SPI "));
+    fmt_u8(dither_spi_percent());
+    serial_put_char('%');
+}
+#endif
+
+/**
+ * @brief Update colour theme on terminal.
+ */
+void show_colour_theme_terminal()
+{
+    set_terminal_line_P(0, 20,
+        (get_colour_theme() == COLOUR_THEME_COLOUR_BLIND
+            ? PSTR("Colour theme: colour blind") : PSTR("Colour theme: normal")));
 }
 
 // Show computer mode on terminal
 void show_com_mode_terminal()
 {
-    move_terminal_cursor(0, 17);
-    clear_to_end_of_line();
-    printf(
-        "Computer mode is %s",
-        (computer_mode ? "search and destroy" : "basic"));
+    set_terminal_line_P(0, 17,
+        (computer_mode ? PSTR("Computer mode is search and destroy")
+            : PSTR("Computer mode is basic")));
 }
 
 void start_screen(void)
 {
     // Clear terminal screen and output a message
     clear_terminal();
+    enable_scrolling_for_whole_display();
     hide_cursor();
     set_display_attribute(FG_WHITE);
-    move_terminal_cursor(10, 4);
-    printf_P(PSTR(" _______    ______  ________  ________  __        ________   ______   __    __  ______  _______  "));
-    move_terminal_cursor(10, 5);
-    printf_P(PSTR("|       \\  /      \\|        \\|        \\|  \\      |        \\ /      \\ |  \\  |  \\|      \\|       \\ "));
-    move_terminal_cursor(10, 6);
-    printf_P(PSTR("| $$$$$$$\\|  $$$$$$\\\\$$$$$$$$ \\$$$$$$$$| $$      | $$$$$$$$|  $$$$$$\\| $$  | $$ \\$$$$$$| $$$$$$$\\"));
-    move_terminal_cursor(10, 7);
-    printf_P(PSTR("| $$__/ $$| $$__| $$  | $$      | $$   | $$      | $$__    | $$___\\$$| $$__| $$  | $$  | $$__/ $$"));
-    move_terminal_cursor(10, 8);
-    printf_P(PSTR("| $$    $$| $$    $$  | $$      | $$   | $$      | $$  \\    \\$$    \\ | $$    $$  | $$  | $$    $$"));
-    move_terminal_cursor(10, 9);
-    printf_P(PSTR("| $$$$$$$\\| $$$$$$$$  | $$      | $$   | $$      | $$$$$    _\\$$$$$$\\| $$$$$$$$  | $$  | $$$$$$$ "));
-    move_terminal_cursor(10, 10);
-    printf_P(PSTR("| $$__/ $$| $$  | $$  | $$      | $$   | $$_____ | $$_____ |  \\__| $$| $$  | $$ _| $$_ | $$      "));
-    move_terminal_cursor(10, 11);
-    printf_P(PSTR("| $$    $$| $$  | $$  | $$      | $$   | $$     \\| $$     \\ \\$$    $$| $$  | $$|   $$ \\| $$      "));
-    move_terminal_cursor(10, 12);
-    printf_P(PSTR(" \\$$$$$$$  \\$$   \\$$   \\$$       \\$$    \\$$$$$$$$ \\$$$$$$$$  \\$$$$$$  \\$$   \\$$ \\$$$$$$ \\$$      "));
+    banner_start();
     move_terminal_cursor(10, 14);
     // change this to your name and student number; remove the chevrons <>
-    printf_P(PSTR("CSSE2010/7201 Project by Ian Pinto - 48006581"));
+    fmt_string_P(PSTR("CSSE2010/7201 Project by Ian Pinto - 48006581"));
 
     // Output the static start screen and wait for a push button
     // to be pushed or a serial input of 's'
     show_start_screen();
 
-    uint32_t last_screen_update, current_time;
-    last_screen_update = get_current_time();
-
-    int8_t frame_number = -2 * ANIMATION_DELAY;
-
     computer_mode = 0;
     show_com_mode_terminal();
 
     show_salvo_mode_terminal();
 
-    // Wait until a button is pressed, or 's' is pressed on the terminal
-    while (1)
-    {
-        // First check for if a 's' is pressed
-        // There are two steps to this
-        // 1) collect any serial input (if available)
-        // 2) check if the input is equal to the character 's'
-        char serial_input = -1;
-        if (serial_input_available())
-        {
-            serial_input = fgetc(stdin);
-        }
-        if (serial_input == 'y' || serial_input == 'Y')
-        {
-            computer_mode = !computer_mode;
-            show_com_mode_terminal();
-        }
-        // If the serial input is 's', then exit the start screen
-        if (serial_input == 's' || serial_input == 'S')
-        {
-            // Human setup, com randomised
-            set_human_setup_mode(1);
-            srand(get_current_time()); // Set seed based on timer time
-            break;
-        }
-        if (serial_input == 'a' || serial_input == 'A')
-        {
-            // Default locations for human and com
-            set_human_setup_mode(0);
-            srand(get_current_time()); // Set seed based on timer time
-            break;
-        }
-        if (serial_input == 'z' || serial_input == 'Z')
-        {
-            // Toggle salvo mode
-            salvo_mode = !salvo_mode;
-            show_salvo_mode_terminal();
-        }
+    show_colour_theme_terminal();
 
-        // Next check for any button presses
-        int8_t btn = button_pushed();
-        if (btn != NO_BUTTON_PUSHED)
+    // Wait until a button is pressed, or 's' or 'a' is pressed on the
+    // terminal
+    uint8_t start_game = 0;
+    while (!start_game)
+    {
+        // Handle the input which has arrived, in order
+        Event event;
+        while (!start_game && events_get(&event))
         {
-            break;
+            if (is_button_press(&event))
+            {
+                // Any button starts the game
+                start_game = 1;
+            }
+            if (event.source != EVENT_SERIAL)
+            {
+                continue;
+            }
+            char serial_input = tolower(event.code);
+            if (serial_input == 'y')
+            {
+                computer_mode = !computer_mode;
+                show_com_mode_terminal();
+                send_modes_telemetry();
+            }
+            // If the serial input is 's', then exit the start screen
+            if (serial_input == 's')
+            {
+                // Human setup, com randomised
+                set_human_setup_mode(1);
+                srand(get_current_time()); // Set seed based on timer time
+                start_game = 1;
+            }
+            if (serial_input == 'a')
+            {
+                // Default locations for human and com
+                set_human_setup_mode(0);
+                srand(get_current_time()); // Set seed based on timer time
+                start_game = 1;
+            }
+            if (serial_input == 'z')
+            {
+                // Toggle salvo mode
+                salvo_mode = !salvo_mode;
+                show_salvo_mode_terminal();
+                send_modes_telemetry();
+            }
+            if (serial_input == 't')
+            {
+                // Toggle colour theme
+                set_colour_theme((get_colour_theme() + 1) % NUM_COLOUR_THEMES);
+                show_colour_theme_terminal();
+                send_modes_telemetry();
+            }
         }
 
-        // every 200 ms, update the animation
-        current_time = get_current_time();
-        if (current_time - last_screen_update > 200)
+        // scroll the start screen animation along when it's due, and
+        // send more of the banner - but only once any status rows which
+        // had to wait (e.g. a mode just toggled) have been sent, so the
+        // banner can't keep them waiting
+        update_start_screen();
+        terminal_service();
+        if (!terminal_rows_waiting())
         {
-            update_start_screen(frame_number);
-            frame_number++;
-            if (frame_number > ANIMATION_LENGTH)
-            {
-                frame_number -= ANIMATION_LENGTH + ANIMATION_DELAY;
-            }
-            last_screen_update = current_time;
+            banner_service();
         }
     }
 }
@@ -244,27 +282,22 @@ void new_game(void)
 
     show_com_mode_terminal();
     show_salvo_mode_terminal();
+    show_colour_theme_terminal();
 
     // Ship setup mode
-    move_terminal_cursor(0, 19);
-    clear_to_end_of_line();
-    printf("Ship setup: ");
-    if (get_human_setup_mode())
-    {
-        printf("manual for human, random for computer");
-    }
-    else
-    {
-        printf("default for human and computer");
-    }
+    set_terminal_line_P(0, 19,
+        (get_human_setup_mode()
+            ? PSTR("Ship setup: manual for human, random for computer")
+            : PSTR("Ship setup: default for human and computer")));
+
+    battle_log_init();
+    board_view_init();
 
     // Initialise the game and display
     initialise_game();
 
-    // Clear a button push or serial input if any are waiting
-    // (The cast to void means the return value is ignored.)
-    (void)button_pushed();
-    clear_serial_input_buffer();
+    // Clear any button pushes or serial input waiting
+    events_clear();
 }
 
 /**
@@ -287,97 +320,63 @@ void write_to_leds(uint8_t val)
     }
 }
 
-int32_t joystick_val_x, joystick_val_y;
+/**
+ * @brief Draw a frame on the LED matrix if one is due (and the next
+ * dithering sub-frame), and send any status rows which had to wait for
+ * room in the serial output buffer
+ */
+void render_if_due()
+{
+    dither_service();
+    terminal_service();
+#ifdef DITHER_STATS
+    show_dither_stats_terminal();
+#endif
+
+    uint32_t current_time = get_current_time();
+    if (current_time >= last_frame_time + RENDER_FRAME_PERIOD)
+    {
+        render_commit_frame();
+        last_frame_time = current_time;
+    }
+}
+
 uint32_t last_joystick_check;
 uint32_t joystick_delay;
-// Dist from upright, at most ~412 each
-int32_t joystick_delta_x, joystick_delta_y;
-uint32_t taxicab_distance;
 
 /**
- * @brief Initialise joystick delay, delta, check times
+ * @brief Initialise joystick delay, check times
  *
  */
 void initialise_joystick()
 {
     last_joystick_check = get_current_time();
-    joystick_delay = 255;
-    joystick_delta_x = 0;
-    joystick_delta_y = 0;
+    joystick_delay = 0;
 }
 
 /**
- * @brief Check joystick, move cursor if needed
+ * @brief Check joystick (see joystick.h), add an event to move the cursor
+ * if needed
  */
 void joystick_check()
 {
-
-    // y
-    ADMUX |= 1;
-    // Start the ADC conversion
-    ADCSRA |= (1 << ADSC);
-    while (ADCSRA & (1 << ADSC))
-    {
-        ; // Wait until conversion finished
-    }
-    joystick_val_y = ADC; // read the value
-
-    // x
-    ADMUX &= ~1;
-    // Start the ADC conversion
-    ADCSRA |= (1 << ADSC);
-    while (ADCSRA & (1 << ADSC))
-    {
-        ; // Wait until conversion finished
-    }
-    joystick_val_x = ADC; // read the value
-
-    // Find dist from upright pos
-    if (joystick_val_x > (511 + 100))
-    {
-        joystick_delta_x = joystick_val_x - (511 + 100);
-    }
-    else if (joystick_val_x < (511 - 100))
-    {
-        joystick_delta_x = joystick_val_x - (511 - 100);
-    }
-    else
-    {
-        joystick_delta_x = 0;
-    }
-    if (joystick_val_y > (511 + 100))
-    {
-        joystick_delta_y = joystick_val_y - (511 + 100);
-    }
-    else if (joystick_val_y < (511 - 100))
-    {
-        joystick_delta_y = joystick_val_y - (511 - 100);
-    }
-    else
-    {
-        joystick_delta_y = 0;
-    }
-
-    // Move cursor
     int8_t dx, dy;
-    dx = ((joystick_delta_x > 0) ? 1 : ((joystick_delta_x < 0) ? -1 : 0));
-    dy = ((joystick_delta_y > 0) ? 1 : ((joystick_delta_y < 0) ? -1 : 0));
+    joystick_delay = joystick_motion(&dx, &dy);
     if (dx || dy)
     {
-        move_cursor(dx, dy);
+        events_add(EVENT_JOYSTICK, JOYSTICK_CODE(dx, dy));
     }
-
-    // Update timing
-    joystick_delay = 600 - pow(pow(joystick_delta_x, 2) + pow(joystick_delta_y, 2), 0.5);
     last_joystick_check = get_current_time();
 }
 
 void play_game(void)
 {
     uint32_t current_time;
-    int8_t btn; // The button pushed
+    Event event; // An input event
+    char key;    // The key it stands for (see event_key())
 
     last_flash_time = get_current_time();
+    last_frame_time = last_flash_time;
 
     // 0 if not paused, 1 if paused
     uint8_t paused = 0;
@@ -397,40 +396,45 @@ void play_game(void)
     // Human setup
     while (get_human_setup_mode())
     {
-        btn = button_pushed();
-        // Serial input made lowercase
-        char serial_input_lower = get_serial_input_lower();
         human_salvo_mode = salvo_mode;
 
-        if (btn == BUTTON0_PUSHED || serial_input_lower == 'd')
-        {
-            // Right
-            move_human_ship(1, 0);
-        }
-        else if (btn == BUTTON1_PUSHED || serial_input_lower == 's')
+        // Handle the input which has arrived, in order (until the last
+        // ship is placed)
+        while (get_human_setup_mode() && events_get(&event))
         {
-            // Down
-            move_human_ship(0, -1);
-        }
-        else if (btn == BUTTON2_PUSHED || serial_input_lower == 'w')
-        {
-            // Up
-            move_human_ship(0, 1);
-        }
-        else if (btn == BUTTON3_PUSHED || serial_input_lower == 'a')
-        {
-            // Left
-            move_human_ship(-1, 0);
-        }
-        else if (serial_input_lower == 'f')
-        {
-            // Place ship
-            place_human_ship();
-        }
-        else if (serial_input_lower == 'r')
-        {
-            rotate_human_ship();
+            key = event_key(&event);
+            if (key == 'd')
+            {
+                // Right
+                move_human_ship(1, 0);
+            }
+            else if (key == 's')
+            {
+                // Down
+                move_human_ship(0, -1);
+            }
+            else if (key == 'w')
+            {
+                // Up
+                move_human_ship(0, 1);
+            }
+            else if (key == 'a')
+            {
+                // Left
+                move_human_ship(-1, 0);
+            }
+            else if (key == 'f')
+            {
+                // Place ship
+                place_human_ship();
+            }
+            else if (key == 'r')
+            {
+                rotate_human_ship();
+            }
         }
+
+        render_if_due();
     }
 
     draw_human_grid();
@@ -445,61 +449,78 @@ void play_game(void)
     // We play the game until it's over
     while (!result)
     {
-        // We need to check if any button has been pushed, this will be
-        // NO_BUTTON_PUSHED if no button has been pushed
-        // Checkout the function comment in `buttons.h` and the implementation
-        // in `buttons.c`.
-        btn = button_pushed();
-        // Serial input made lowercase
-        char serial_input_lower = get_serial_input_lower();
         human_salvo_mode = salvo_mode;
 
-        if (!paused)
+        // Handle all the input which has arrived since last time around
+        // the loop (button pushes, serial input and joystick movements - see
+        // events.h), in the order it happened
+        while (!result && events_get(&event))
         {
-            valid_human_move = 0;
-            if (salvo_mode)
+            key = event_key(&event);
+            if (key == 'p')
             {
-                write_to_leds(shots_left(0));
+                if (paused)
+                {
+                    paused = 0;
+                    set_terminal_line_P(0, 11, PSTR(""));
+                    last_flash_time = get_current_time() - time_delta;
+                }
+                else
+                {
+                    paused = 1;
+                    set_terminal_line_P(0, 11, PSTR("Game paused."));
+                    time_delta = get_current_time() - last_flash_time;
+                }
+                continue;
+            }
+            if (paused)
+            {
+                continue;
             }
 
-            if (btn == BUTTON0_PUSHED || serial_input_lower == 'd')
+            valid_human_move = 0;
+            if (event.source == EVENT_JOYSTICK)
+            {
+                move_cursor(JOYSTICK_DX(event.code), JOYSTICK_DY(event.code));
+            }
+            else if (key == 'd')
             {
                 // Right
                 move_cursor(1, 0);
             }
-            else if (btn == BUTTON1_PUSHED || serial_input_lower == 's')
+            else if (key == 's')
             {
                 // Down
                 move_cursor(0, -1);
             }
-            else if (btn == BUTTON2_PUSHED || serial_input_lower == 'w')
+            else if (key == 'w')
             {
                 // Up
                 move_cursor(0, 1);
             }
-            else if (btn == BUTTON3_PUSHED || serial_input_lower == 'a')
+            else if (key == 'a')
             {
                 // Left
                 move_cursor(-1, 0);
             }
-            else if (serial_input_lower == 'f')
+            else if (key == 'f')
             {
                 // Fire
                 valid_human_move = human_turn();
             }
-            else if (serial_input_lower == 'b')
+            else if (key == 'b')
             {
                 valid_human_move = bomb_cheat();
             }
-            else if (serial_input_lower == 'n')
+            else if (key == 'n')
             {
                 valid_human_move = horizontal_cheat();
             }
-            else if (serial_input_lower == 'm')
+            else if (key == 'm')
             {
                 valid_human_move = vertical_cheat();
             }
-            else if (serial_input_lower == 'c')
+            else if (key == 'c')
             {
                 // Cheats
                 set_cheat_visible(1);
@@ -507,6 +528,30 @@ void play_game(void)
                 show_cheat();
             }
 
+            if (valid_human_move && shots_left(0) == 0)
+            {
+                complete_turn(0);
+                if (!is_game_over())
+                {
+                    write_to_leds(shots_left(1));
+                    while (shots_left(1) != 0)
+                    {
+                        computer_turn();
+                        write_to_leds(shots_left(1));
+                    }
+                    complete_turn(1);
+                }
+            }
+            result = is_game_over();
+        }
+
+        if (!paused && !result)
+        {
+            if (salvo_mode)
+            {
+                write_to_leds(shots_left(0));
+            }
+
             current_time = get_current_time();
             if (current_time >= last_flash_time + 200)
             {
@@ -528,62 +573,12 @@ void play_game(void)
             }
             if (current_time >= last_joystick_check + joystick_delay)
             {
+                // Adds a joystick event if it has moved
                 joystick_check();
             }
-
-            // // Joystick, TODO delete
-            // if (x_or_y == 0)
-            // {
-            //     // x
-            //     ADMUX &= ~1;
-            // }
-            // else
-            // {
-            //     // y
-            //     ADMUX |= 1;
-            // }
-            // // Start the ADC conversion
-            // ADCSRA |= (1 << ADSC);
-            // while (ADCSRA & (1 << ADSC))
-            // {
-            //     ; /* Wait until conversion finished */
-            // }
-            // joystick_value = ADC; // read the value
-
-            if (valid_human_move && shots_left(0) == 0)
-            {
-                complete_turn(0);
-                if (is_game_over())
-                {
-                    break;
-                }
-                write_to_leds(shots_left(1));
-                while (shots_left(1) != 0)
-                {
-                    computer_turn();
-                    write_to_leds(shots_left(1));
-                }
-                complete_turn(1);
-            }
-            result = is_game_over();
-        }
-        if (serial_input_lower == 'p')
-        {
-            if (paused)
-            {
-                paused = 0;
-                move_terminal_cursor(0, 11);
-                clear_to_end_of_line();
-                last_flash_time = get_current_time() - time_delta;
-            }
-            else
-            {
-                paused = 1;
-                move_terminal_cursor(0, 11);
-                printf("Game paused.");
-                time_delta = get_current_time() - last_flash_time;
-            }
         }
+
+        render_if_due();
     }
     // We get here if the game is over.
 }
@@ -592,10 +587,14 @@ void handle_game_over()
 {
     set_cheat_visible(0);
 
+    // Only the short heading goes ahead of other output (the priority
+    // lane is small), the instructions follow in turn
+    begin_priority_output();
     move_terminal_cursor(10, 14);
-    printf_P(PSTR("GAME OVER"));
-    move_terminal_cursor(10, 15);
-    printf_P(PSTR("Press a button or 's'/'S' to start a new game"));
+    fmt_string_P(PSTR("GAME OVER"));
+    end_priority_output();
+    set_terminal_line_P(10, 15,
+        PSTR("Press a button or 's'/'S' to start a new game"));
 
     if (is_game_over() == 1)
     {
@@ -608,15 +607,22 @@ void handle_game_over()
      * @brief 1 if the human won, 2 if the computer won
      */
     uint8_t winner = is_game_over();
-    move_terminal_cursor(0, 9);
-    printf(
-        "The %s won.",
-        ((winner == 1) ? "human" : "computer"));
+    telemetry_send(TELEMETRY_GAME_OVER, &winner, 1);
+    set_terminal_line_P(0, 9,
+        ((winner == 1) ? PSTR("The human won.") : PSTR("The computer won.")));
 
     game_over_matrix();
 
-    while (button_pushed() == NO_BUTTON_PUSHED && tolower(get_serial_input()) != 's')
+    // Wait for a button push or 's'/'S'
+    uint8_t start_again = 0;
+    while (!start_again)
     {
-        ; // wait
+        Event event;
+        while (!start_again && events_get(&event))
+        {
+            start_again = is_button_press(&event)
+                || (event.source == EVENT_SERIAL && tolower(event.code) == 's');
+        }
+        render_if_due();
     }
 }
@@ -0,0 +1,85 @@
+/*
+ * render.c
+ *
+ * Draws the game boards on the LED matrix, one frame at a time.
+ */
+
+#include "render.h"
+#include <stdint.h>
+#include "ledmatrix.h"
+#include "game.h"
+#include "board_view.h"
+
+// Cells to redraw. Bit x of human_marks[y] is set if the human grid cell
+// at (x, y) needs to be redrawn, likewise for the computer grid.
+static uint8_t human_marks[GRID_NUM_ROWS];
+static uint8_t computer_marks[GRID_NUM_ROWS];
+
+void render_init(void)
+{
+	for (uint8_t y = 0; y < GRID_NUM_ROWS; y++)
+	{
+		human_marks[y] = 0;
+		computer_marks[y] = 0;
+	}
+}
+
+void render_mark_human_cell(uint8_t x, uint8_t y)
+{
+	if (x < GRID_NUM_COLUMNS && y < GRID_NUM_ROWS)
+	{
+		human_marks[y] |= (1 << x);
+	}
+}
+
+void render_mark_computer_cell(uint8_t x, uint8_t y)
+{
+	if (x < GRID_NUM_COLUMNS && y < GRID_NUM_ROWS)
+	{
+		computer_marks[y] |= (1 << x);
+	}
+}
+
+void render_mark_human_grid(void)
+{
+	for (uint8_t y = 0; y < GRID_NUM_ROWS; y++)
+	{
+		human_marks[y] = 0xFF;
+	}
+}
+
+void render_mark_computer_grid(void)
+{
+	for (uint8_t y = 0; y < GRID_NUM_ROWS; y++)
+	{
+		computer_marks[y] = 0xFF;
+	}
+}
+
+void render_commit_frame(void)
+{
+	board_view_commit(human_marks, computer_marks);
+
+	// Colours are written to the matrix as one batch so that only
+	// changed pixels are sent, using the fewest bytes, up to the budget
+	ledmatrix_begin_batch();
+	for (uint8_t y = 0; y < GRID_NUM_ROWS; y++)
+	{
+		for (uint8_t x = 0; x < GRID_NUM_COLUMNS; x++)
+		{
+			if (human_marks[y] & (1 << x))
+			{
+				ledmatrix_draw_pixel_index_in_human_grid(x, y,
+						get_human_cell_colour(x, y));
+			}
+			if (computer_marks[y] & (1 << x))
+			{
+				ledmatrix_draw_pixel_index_in_computer_grid(x, y,
+						get_computer_cell_colour(x, y));
+			}
+		}
+		human_marks[y] = 0;
+		computer_marks[y] = 0;
+	}
+	ledmatrix_end_batch_limited(RENDER_FRAME_BUDGET);
+}
@@ -0,0 +1,37 @@
+/*
+ * render.h
+ *
+ * Draws the game boards on the LED matrix. Game code doesn't draw cells
+ * itself - it marks the cells whose appearance may have changed, and
+ * once per frame the colour of each marked cell is worked out from the
+ * game state (see get_human_cell_colour() and get_computer_cell_colour()
+ * in game.h) and sent to the matrix. A cell marked several times between
+ * frames is only drawn once, and each frame sends at most
+ * RENDER_FRAME_BUDGET bytes over SPI (anything left over goes out in the
+ * following frames). The marked cells are also redrawn on the terminal
+ * (see board_view.h).
+ */
+
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#include <stdint.h>
+
+// Time between frames (ms) and the most SPI bytes sent per frame
+#define RENDER_FRAME_PERIOD 20
+#define RENDER_FRAME_BUDGET 64
+
+// Forget any marked cells
+void render_init(void);
+
+// Mark a single cell, or a whole grid, as needing to be redrawn
+void render_mark_human_cell(uint8_t x, uint8_t y);
+void render_mark_computer_cell(uint8_t x, uint8_t y);
+void render_mark_human_grid(void);
+void render_mark_computer_grid(void);
+
+// Work out the colours of the marked cells and send them to the matrix.
+// Should be called every RENDER_FRAME_PERIOD ms while a game is shown.
+void render_commit_frame(void);
+
+#endif /* RENDER_H_ */
@@ -18,42 +18,187 @@
  * The function input_available() can be used to test whether there is
  * input available to read from stdin.
  *
+ * Output goes through one of two lanes. Normally characters go to the
+ * (large) normal lane. Between serial_begin_priority() and
+ * serial_end_priority() they go to the (small) priority lane instead,
+ * and the message is wrapped in ESC 7 / ESC 8 (save and restore cursor).
+ * The UDR empty interrupt handler sends a priority message as soon as the
+ * normal lane isn't part way through an escape sequence, so it doesn't
+ * wait behind everything already queued, and the terminal then carries on
+ * with the normal lane where it left off. serial_try_write() and
+ * serial_output_space() let callers avoid blocking when the normal lane
+ * is full.
+ *
+ * Input uses flow control so that a sender going at full speed doesn't
+ * overrun the input buffer: once INPUT_STOP_LEVEL characters are waiting
+ * we send XOFF (and raise RTS if SERIAL_RTS_BIT is defined), and once
+ * they have been read down to INPUT_RESUME_LEVEL we send XON (and lower
+ * RTS). XON/XOFF aren't sent while text output is off, as they can't be
+ * told apart from binary output. Characters lost anyway are counted, see
+ * serial_input_overruns().
+ *
+ * Alternatively, serial_set_input_events() makes the receive interrupt
+ * handler add each character to the input event queue (see events.h)
+ * instead of the input buffer. Flow control then follows the number of
+ * events waiting (of any kind), stopping at EVENT_STOP_LEVEL and resuming
+ * at EVENT_RESUME_LEVEL as events are taken (events.c calls
+ * serial_input_taken()).
+ *
  */
 
 #include "serialio.h"
+#include "terminalio.h"
+#include "events.h"
+#include "clock.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
-/* System clock rate in Hz. (L at the end indicates this is a long constant) */
-#define SYSCLK 8000000L
+/* Baud rate register values (rounded to the nearest) for normal and
+ * double speed (U2X) modes, and the baud rates they give. We use normal
+ * mode if it is within 2% of SERIAL_BAUD, otherwise double speed mode if
+ * that is within 1.5% (it has less tolerance for timing errors).
+ */
+#define UBRR_NORMAL ((F_CPU + 8UL * SERIAL_BAUD) / (16UL * SERIAL_BAUD) - 1)
+#define UBRR_DOUBLE ((F_CPU + 4UL * SERIAL_BAUD) / (8UL * SERIAL_BAUD) - 1)
+#define BAUD_NORMAL (F_CPU / (16UL * (UBRR_NORMAL + 1)))
+#define BAUD_DOUBLE (F_CPU / (8UL * (UBRR_DOUBLE + 1)))
+#define BAUD_ERROR_PER_MILLE(baud) (((baud) > SERIAL_BAUD ? \
+		(baud) - SERIAL_BAUD : SERIAL_BAUD - (baud)) * 1000 / SERIAL_BAUD)
+
+#if 16UL * SERIAL_BAUD <= F_CPU && UBRR_NORMAL <= 4095 \
+		&& BAUD_ERROR_PER_MILLE(BAUD_NORMAL) <= 20
+#define UBRR_VALUE UBRR_NORMAL
+#define USE_U2X 0
+#elif 8UL * SERIAL_BAUD <= F_CPU && UBRR_DOUBLE <= 4095 \
+		&& BAUD_ERROR_PER_MILLE(BAUD_DOUBLE) <= 15
+#define UBRR_VALUE UBRR_DOUBLE
+#define USE_U2X 1
+#else
+#error "SERIAL_BAUD can't be made accurately enough from F_CPU"
+#endif
 
 /* Global variables */
-/* Circular buffer to hold outgoing characters. The insert_pos variable
- * keeps track of the position (0 to OUTPUT_BUFFER_SIZE-1) that the next
- * outgoing character should be written to. bytes_in_buffer keeps
- * count of the number of characters currently stored in the buffer 
- * (ranging from 0 to OUTPUT_BUFFER_SIZE). This number of bytes immediately
- * prior to the current insert_pos are the bytes waiting to be output.
- * If the insert_pos reaches the end of the buffer it will wrap around
- * to the beginning (assuming those bytes have been output).
- * NOTE - OUTPUT_BUFFER_SIZE can not be larger than 255 without changing
- * the type of the variables below (currently defined as 8 bit unsigned ints).
+/* Circular buffers for outgoing and incoming characters. Each is a
+ * single-producer/single-consumer ring: characters are written at head
+ * (which only the producer changes) and read from tail (which only the
+ * consumer changes). The buffer is empty when head == tail and full when
+ * advancing head would make it equal tail, so one slot is never used.
+ * Indices are 8 bits, so reading or writing one is a single instruction
+ * and neither side has to turn interrupts off - the producer writes the
+ * character before moving head, and the consumer reads it before moving
+ * tail. Sizes must be powers of two (at most 256) so wrapping around is
+ * just a mask.
+ * The main program produces output and the UDR empty interrupt handler
+ * consumes it. The receive interrupt handler produces input and the main
+ * program consumes it. (Characters echoed by the receive interrupt handler
+ * don't go through the output buffer - that would make two producers -
+ * see echo_char below.)
+ */
+#define OUTPUT_BUFFER_SIZE 256
+#define OUTPUT_BUFFER_MASK (OUTPUT_BUFFER_SIZE - 1)
+static volatile char out_buffer[OUTPUT_BUFFER_SIZE];
+static volatile uint8_t out_head;
+static volatile uint8_t out_tail;
+
+#define INPUT_BUFFER_SIZE 64
+#define INPUT_BUFFER_MASK (INPUT_BUFFER_SIZE - 1)
+static volatile char input_buffer[INPUT_BUFFER_SIZE];
+static volatile uint8_t input_head;
+static volatile uint8_t input_tail;
+
+/* Input flow control. The stop level leaves room for the characters a
+ * sender (e.g. a USB serial adapter) may send before it notices XOFF.
+ * input_stopped is 1 while we have asked the sender to stop. flow_char
+ * is XON or XOFF if one is waiting to be sent (ahead of everything else),
+ * otherwise 0.
+ */
+#define INPUT_STOP_LEVEL (INPUT_BUFFER_SIZE / 2)
+#define INPUT_RESUME_LEVEL 8
+#define EVENT_STOP_LEVEL (EVENT_QUEUE_SIZE / 2)
+#define EVENT_RESUME_LEVEL 4
+#define XON 0x11
+#define XOFF 0x13
+static volatile uint8_t input_stopped;
+static volatile char flow_char;
+
+/* RTS (an output, low when we can take input) if SERIAL_RTS_BIT is
+ * defined - it is that bit of SERIAL_RTS_PORT (port D by default). The
+ * receive interrupt handler changes it, so no other code should change
+ * that port with interrupts on unless it does so with sbi/cbi.
+ */
+#ifdef SERIAL_RTS_BIT
+#ifndef SERIAL_RTS_PORT
+#define SERIAL_RTS_PORT PORTD
+#define SERIAL_RTS_DDR DDRD
+#endif
+#define RTS_READY() (SERIAL_RTS_PORT &= ~(1 << SERIAL_RTS_BIT))
+#define RTS_STOP() (SERIAL_RTS_PORT |= (1 << SERIAL_RTS_BIT))
+#else
+#define RTS_READY()
+#define RTS_STOP()
+#endif
+
+/* Statistics: characters lost (input buffer full, or overwritten in the
+ * UART before we could read them), and the most characters there have
+ * been waiting in the input buffer.
+ */
+static volatile uint16_t input_overruns;
+static volatile uint8_t input_high_water;
+
+/* 1 if received characters go to the input event queue */
+static volatile uint8_t input_events;
+
+#if (OUTPUT_BUFFER_SIZE & OUTPUT_BUFFER_MASK) || OUTPUT_BUFFER_SIZE > 256 \
+		|| (INPUT_BUFFER_SIZE & INPUT_BUFFER_MASK) || INPUT_BUFFER_SIZE > 256
+#error Serial buffer sizes must be powers of two no larger than 256
+#endif
+
+/* Priority lane - a ring like out_buffer. The main program is putting
+ * characters into it while priority_lane is set. priority_reserve slots
+ * are kept free for the ESC 8 which ends a priority message (so it still
+ * fits if characters have to be discarded).
  */
-#define OUTPUT_BUFFER_SIZE 255
-volatile char out_buffer[OUTPUT_BUFFER_SIZE];
-volatile uint8_t out_insert_pos;
-volatile uint8_t bytes_in_out_buffer;
+#define PRIORITY_BUFFER_SIZE 64
+#define PRIORITY_BUFFER_MASK (PRIORITY_BUFFER_SIZE - 1)
+static volatile char priority_buffer[PRIORITY_BUFFER_SIZE];
+static volatile uint8_t priority_head;
+static volatile uint8_t priority_tail;
+static uint8_t priority_lane;
+static uint8_t priority_reserve;
 
-/* Circular buffer to hold incoming characters. Works on same principle
- * as output buffer
+/* Whether output through stdio and serial_put_char() is sent (it is
+ * discarded while this is 0, see serial_set_text_output())
  */
-#define INPUT_BUFFER_SIZE 16
-volatile char input_buffer[INPUT_BUFFER_SIZE];
-volatile uint8_t input_insert_pos;
-volatile uint8_t bytes_in_input_buffer;
-volatile uint8_t input_overrun;
+static volatile uint8_t text_output;
+
+#if (PRIORITY_BUFFER_SIZE & PRIORITY_BUFFER_MASK) || PRIORITY_BUFFER_SIZE > 256
+#error Serial buffer sizes must be powers of two no larger than 256
+#endif
+
+/* Used only by the UDR empty interrupt handler: whether it is part way
+ * through sending a priority message (it stays on the priority lane until
+ * the ESC 8), whether the last priority character was ESC, and how far
+ * it is through an escape sequence from the normal lane (including
+ * strings such as ESC _ ... ESC \).
+ */
+static uint8_t sending_priority;
+static uint8_t priority_escape;
+#define OUT_ESC_NONE 0
+#define OUT_ESC_START 1
+#define OUT_ESC_CSI 2
+#define OUT_ESC_STRING 3
+#define OUT_ESC_STRING_END 4
+static uint8_t out_escape_state;
+
+/* Character waiting to be echoed (0 if none). Set by the receive interrupt
+ * handler and sent by the UDR empty interrupt handler ahead of the output
+ * buffer. If a second character arrives before the first has been echoed
+ * then the first is not echoed.
+ */
+static volatile char echo_char;
 
 /* Variable to keep track of whether incoming characters are to be echoed
  * back or not.
@@ -62,7 +207,7 @@ static int8_t do_echo;
 
 /* Function prototypes 
  */
-void init_serial_stdio(long baudrate, int8_t echo);
+void init_serial_stdio(int8_t echo);
 static int uart_put_char(char, FILE*);
 static int uart_get_char(FILE*);
 
@@ -72,30 +217,37 @@ static int uart_get_char(FILE*);
 static FILE myStream = FDEV_SETUP_STREAM(uart_put_char, uart_get_char,
 		_FDEV_SETUP_RW);
 
-void init_serial_stdio(long baudrate, int8_t echo)
+void init_serial_stdio(int8_t echo)
 {
-	uint16_t ubrr;
 	/*
 	 * Initialise our buffers
 	*/
-	out_insert_pos = 0;
-	bytes_in_out_buffer = 0;
-	input_insert_pos = 0;
-	bytes_in_input_buffer = 0;
-	input_overrun = 0;
+	out_head = out_tail = 0;
+	priority_head = priority_tail = 0;
+	priority_lane = priority_reserve = 0;
+	text_output = 1;
+	sending_priority = priority_escape = 0;
+	out_escape_state = OUT_ESC_NONE;
+	input_head = input_tail = 0;
+	input_stopped = 0;
+	flow_char = 0;
+	input_overruns = 0;
+	input_high_water = 0;
+	input_events = 0;
+	echo_char = 0;
+#ifdef SERIAL_RTS_BIT
+	SERIAL_RTS_DDR |= (1 << SERIAL_RTS_BIT);
+#endif
+	RTS_READY();
 	
 	/*
 	 * Record whether we're going to echo characters or not
 	*/
 	do_echo = echo;
 	
-	/* Configure the serial port baud rate */
-	/* (This differs from the datasheet formula so that we get 
-	 * rounding to the nearest integer while using integer division
-	 * (which truncates)).
-	*/
-	ubrr = (((SYSCLK / (8 * baudrate)) + 1) / 2) - 1;
-	UBRR0 = ubrr;
+	/* Configure the serial port baud rate (worked out above) */
+	UBRR0 = UBRR_VALUE;
+	UCSR0A = USE_U2X ? (1 << U2X0) : 0;
 	
 	/*
 	 * Enable transmission and receiving via UART. We don't enable
@@ -121,25 +273,211 @@ void init_serial_stdio(long baudrate, int8_t echo)
 
 int8_t serial_input_available(void)
 {
-	return bytes_in_input_buffer != 0;
+	return input_head != input_tail;
+}
+
+/* Ask the sender to stop (called by the receive interrupt handler) */
+static void stop_input(void)
+{
+	if (!input_stopped)
+	{
+		input_stopped = 1;
+		if (text_output)
+		{
+			flow_char = XOFF;
+			UCSR0B |= (1 << UDRIE0);
+		}
+		RTS_STOP();
+	}
+}
+
+/* Tell the sender to start again if it was stopped and we have read
+ * enough of the input buffer (or event queue)
+ */
+static void resume_input(void)
+{
+	if (!input_stopped)
+	{
+		return;
+	}
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	if (input_stopped && (input_events
+			? events_waiting() <= EVENT_RESUME_LEVEL
+			: ((input_head - input_tail) & INPUT_BUFFER_MASK) <= INPUT_RESUME_LEVEL))
+	{
+		input_stopped = 0;
+		if (text_output)
+		{
+			flow_char = XON;
+			UCSR0B |= (1 << UDRIE0);
+		}
+		RTS_READY();
+	}
+	if (interrupts_enabled)
+	{
+		sei();
+	}
 }
 
 void clear_serial_input_buffer(void)
 {
-	/* Just adjust our buffer data so it looks empty */
-	input_insert_pos = 0;
-	bytes_in_input_buffer = 0;
+	/* Just discard everything up to the head (only we move the tail) */
+	input_tail = input_head;
+	resume_input();
 }
 
-static int uart_put_char(char c, FILE* stream)
+void serial_set_input_events(uint8_t enabled)
+{
+	input_events = enabled;
+	clear_serial_input_buffer();
+}
+
+void serial_input_taken(void)
+{
+	resume_input();
+}
+
+uint16_t serial_input_overruns(void)
 {
-	uint8_t interrupts_enabled;
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	uint16_t overruns = input_overruns;
+	if (interrupts_enabled)
+	{
+		sei();
+	}
+	return overruns;
+}
+
+uint8_t serial_input_high_water(void)
+{
+	return input_high_water;
+}
+
+void serial_clear_input_stats(void)
+{
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	input_overruns = 0;
+	input_high_water = 0;
+	if (interrupts_enabled)
+	{
+		sei();
+	}
+}
+
+/* Number of characters which can be added to the current lane */
+static uint8_t lane_space(void)
+{
+	if (priority_lane)
+	{
+		uint8_t space = (priority_tail - priority_head - 1)
+				& PRIORITY_BUFFER_MASK;
+		return (space > priority_reserve) ? space - priority_reserve : 0;
+	}
+	return (out_tail - out_head - 1) & OUTPUT_BUFFER_MASK;
+}
+
+/* Add a character to the current lane (which must have space for it) */
+static void queue_char(char c)
+{
+	/* Store the character and then advance the head so the ISR can
+	 * see it, then make sure the UDR empty interrupt is enabled so that
+	 * it will fire and deal with the character. (The ISR may disable
+	 * the interrupt between us reading and writing UCSR0B, but only
+	 * if it had nothing to send before we advanced the head - so
+	 * enabling it again is always right.)
+	 */
+	if (priority_lane)
+	{
+		uint8_t head = priority_head;
+		priority_buffer[head] = c;
+		priority_head = (head + 1) & PRIORITY_BUFFER_MASK;
+	}
+	else
+	{
+		uint8_t head = out_head;
+		out_buffer[head] = c;
+		out_head = (head + 1) & OUTPUT_BUFFER_MASK;
+	}
+	UCSR0B |= (1 << UDRIE0);
 	
+	/* Let the terminal module follow the cursor position */
+	if (text_output)
+	{
+		terminal_output_char(c);
+	}
+}
+
+/* Add a block of characters (from flash if in_flash is set) to the
+ * current lane, which must have space for them. As for queue_char() but
+ * the head is only advanced (and the interrupt enabled) once, after the
+ * whole block has been copied.
+ */
+static void queue_block(const char* data, uint8_t length, uint8_t in_flash)
+{
+	volatile char* buffer = priority_lane ? priority_buffer : out_buffer;
+	uint8_t mask = priority_lane ? PRIORITY_BUFFER_MASK : OUTPUT_BUFFER_MASK;
+	uint8_t head = priority_lane ? priority_head : out_head;
+	for (uint8_t i = 0; i < length; i++)
+	{
+		char c = in_flash ? pgm_read_byte(&data[i]) : data[i];
+		buffer[head] = c;
+		head = (head + 1) & mask;
+		if (text_output)
+		{
+			terminal_output_char(c);
+		}
+	}
+	if (priority_lane)
+	{
+		priority_head = head;
+	}
+	else
+	{
+		out_head = head;
+	}
+	UCSR0B |= (1 << UDRIE0);
+}
+
+/* Output a block, waiting for space as uart_put_char() does */
+static void write_block(const char* data, uint16_t length, uint8_t in_flash)
+{
+	if (!text_output)
+	{
+		return;
+	}
+	while (length > 0)
+	{
+		uint8_t space = lane_space();
+		if (space == 0)
+		{
+			if (!bit_is_set(SREG, SREG_I))
+			{
+				terminal_cursor_lost();
+				return;
+			}
+			continue;
+		}
+		uint8_t count = (length < space) ? length : space;
+		queue_block(data, count, in_flash);
+		data += count;
+		length -= count;
+	}
+}
+
+static int uart_put_char(char c, FILE* stream)
+{
 	/* Add the character to the buffer for transmission (if there 
 	 * is space to do so). If not we wait until the buffer has space.
 	 * If the character is \n, we output \r (carriage return)
 	 * also.
 	*/
+	if (!text_output)
+	{
+		return 0;
+	}
 	if (c == '\n')
 	{
 		uart_put_char('\r', stream);
@@ -149,81 +487,108 @@ static int uart_put_char(char c, FILE* stream)
 	 * abort - we don't output the character since the buffer will
 	 * never be emptied if interrupts are disabled. If the buffer is full
 	 * and interrupts are enabled then we loop until the buffer has 
-	 * enough space. The bytes_in_buffer variable will get modified by the
-	 * ISR which extracts bytes from the buffer.
+	 * space. The tail will get modified by the ISR which extracts bytes
+	 * from the buffer.
 	*/
-	interrupts_enabled = bit_is_set(SREG, SREG_I);
-	while (bytes_in_out_buffer >= OUTPUT_BUFFER_SIZE)
+	while (lane_space() == 0)
 	{
-		if (!interrupts_enabled)
+		if (!bit_is_set(SREG, SREG_I))
 		{
+			terminal_cursor_lost();
 			return 1;
 		}		
 		/* else do nothing */
 	}
-	
-	/* Add the character to the buffer for transmission if there
-	 * is space to do so. We advance the insert_pos to the next
-	 * character position. If this is beyond the end of the buffer
-	 * we wrap around back to the beginning of the buffer 
-	 * NOTE: we disable interrupts before modifying the buffer. This
-	 * prevents the ISR from modifying the buffer at the same time.
-	 * We reenable them if they were enabled when we entered the
-	 * function.
-	*/	
-	cli();
-	out_buffer[out_insert_pos++] = c;
-	bytes_in_out_buffer++;
-	if (out_insert_pos == OUTPUT_BUFFER_SIZE)
+	queue_char(c);
+	return 0;
+}
+
+void serial_put_char(char c)
+{
+	uart_put_char(c, &myStream);
+}
+
+uint8_t serial_output_space(void)
+{
+	return lane_space();
+}
+
+uint8_t serial_try_write(const char* data, uint8_t length)
+{
+	uint8_t space = lane_space();
+	if (length > space)
 	{
-		/* Wrap around buffer pointer if necessary */
-		out_insert_pos = 0;
+		length = space;
 	}
-	/* Reenable interrupts (UDR Empty interrupt may have been
-	 * disabled) - we ensure it is now enabled so that it will
-	 * fire and deal with the next character in the buffer. */
-	UCSR0B |= (1 << UDRIE0);
-	if (interrupts_enabled)
+	queue_block(data, length, 0);
+	return length;
+}
+
+void serial_write(const void* data, uint16_t length)
+{
+	write_block(data, length, 0);
+}
+
+void serial_write_P(const void* data, uint16_t length)
+{
+	write_block(data, length, 1);
+}
+
+void serial_set_text_output(uint8_t enabled)
+{
+	if (enabled && !text_output)
 	{
-		sei();
+		/* Whatever was sent meanwhile wasn't text, so once it has all
+		 * gone we forget about any escape sequence it seemed to start
+		 * (and where the terminal's cursor is)
+		 */
+		while (out_tail != out_head && bit_is_set(SREG, SREG_I))
+		{
+			/* wait */
+		}
+		uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+		cli();
+		out_escape_state = OUT_ESC_NONE;
+		if (interrupts_enabled)
+		{
+			sei();
+		}
+		terminal_cursor_lost();
 	}
-	return 0;
+	text_output = enabled;
+}
+
+void serial_begin_priority(void)
+{
+	priority_lane = 1;
+	priority_reserve = 2;
+	uart_put_char('\x1b', &myStream);
+	uart_put_char('7', &myStream);
+}
+
+void serial_end_priority(void)
+{
+	priority_reserve = 0;
+	uart_put_char('\x1b', &myStream);
+	uart_put_char('8', &myStream);
+	priority_lane = 0;
 }
 
 int uart_get_char(FILE* stream)
 {
 	/* Wait until we've received a character */
-	while (bytes_in_input_buffer == 0)
+	while (input_head == input_tail)
 	{
 		/* do nothing */
 	}
 	
-	/*
-	 * Turn interrupts off and remove a character from the input
-	 * buffer. We reenable interrupts if they were on.
-	 * The pending character is the one which is byte_in_input_buffer
-	 * characters before the insert position (taking into account
-	 * that we may need to wrap around).
+	/* Take the character at the tail, then advance the tail (which
+	 * frees the slot for the ISR)
 	 */
-	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
-	cli();
-	char c;
-	if (input_insert_pos - bytes_in_input_buffer < 0)
-	{
-		/* Need to wrap around */
-		c = input_buffer[input_insert_pos - bytes_in_input_buffer
-				+ INPUT_BUFFER_SIZE];
-	} else
-	{
-		c = input_buffer[input_insert_pos - bytes_in_input_buffer];
-	}
-	
-	/* Decrement our count of bytes in the input buffer */
-	bytes_in_input_buffer--;
-	if (interrupts_enabled)
-	{
-		sei();
-	}	
+	uint8_t tail = input_tail;
+	char c = input_buffer[tail];
+	input_tail = (tail + 1) & INPUT_BUFFER_MASK;
+	resume_input();
 	return c;
 }
 
@@ -233,32 +598,79 @@ int uart_get_char(FILE* stream)
  */
 ISR(USART0_UDRE_vect) 
 {
-	/* Check if we have data in our buffer */
-	if (bytes_in_out_buffer > 0)
-	{
-		/* Yes we do - remove the pending byte and output it
-		 * via the UART. The pending byte (character) is the
-		 * one which is "bytes_in_buffer" characters before the 
-		 * insert_pos (taking into account that we may 
-		 * need to wrap around to the end of the buffer).
+	/* Send any XON/XOFF first, then any echoed character */
+	char c = flow_char;
+	if (c)
+	{
+		flow_char = 0;
+		UDR0 = c;
+		return;
+	}
+	c = echo_char;
+	if (c)
+	{
+		echo_char = 0;
+		UDR0 = c;
+		return;
+	}
+	
+	/* Then the priority lane. We only start a priority message between
+	 * escape sequences in the normal lane, and once started we finish it
+	 * (up to its ESC 8) before going back to the normal lane - if the
+	 * rest of it hasn't been queued yet we wait for it.
+	 */
+	uint8_t tail = priority_tail;
+	if (sending_priority
+			|| (out_escape_state == OUT_ESC_NONE && tail != priority_head))
+	{
+		if (tail == priority_head)
+		{
+			UCSR0B &= ~(1 << UDRIE0);
+			return;
+		}
+		c = priority_buffer[tail];
+		UDR0 = c;
+		priority_tail = (tail + 1) & PRIORITY_BUFFER_MASK;
+		sending_priority = !(priority_escape && c == '8');
+		priority_escape = (c == '\x1b');
+		return;
+	}
+	
+	/* Then the normal lane */
+	tail = out_tail;
+	if (tail != out_head)
+	{
+		c = out_buffer[tail];
+		UDR0 = c;
+		out_tail = (tail + 1) & OUTPUT_BUFFER_MASK;
+		
+		/* Follow escape sequences (ESC x, ESC [ ... final character,
+		 * or a string: ESC _, ESC ] or ESC P ... ESC \)
 		 */
-		char c;
-		if (out_insert_pos - bytes_in_out_buffer < 0)
+		if (out_escape_state == OUT_ESC_START)
+		{
+			out_escape_state = (c == '[') ? OUT_ESC_CSI
+					: (c == '_' || c == ']' || c == 'P') ? OUT_ESC_STRING
+					: OUT_ESC_NONE;
+		} else if (out_escape_state == OUT_ESC_CSI)
+		{
+			if (c >= 0x40 && c <= 0x7e)
+			{
+				out_escape_state = OUT_ESC_NONE;
+			}
+		} else if (out_escape_state == OUT_ESC_STRING)
+		{
+			if (c == '\x1b')
+			{
+				out_escape_state = OUT_ESC_STRING_END;
+			}
+		} else if (out_escape_state == OUT_ESC_STRING_END)
 		{
-			/* Need to wrap around */
-			c = out_buffer[out_insert_pos - bytes_in_out_buffer
-				+ OUTPUT_BUFFER_SIZE];
-		} else
+			out_escape_state = (c == '\\') ? OUT_ESC_NONE : OUT_ESC_STRING;
+		} else if (c == '\x1b')
 		{
-			c = out_buffer[out_insert_pos - bytes_in_out_buffer];
+			out_escape_state = OUT_ESC_START;
 		}
-		/* Decrement our count of the number of bytes in the 
-		 * buffer 
-		 */
-		bytes_in_out_buffer--;
-		
-		/* Output the character via the UART */
-		UDR0 = c;
 	} else
 	{
 		/* No data in the buffer. We disable the UART Data
@@ -279,48 +691,82 @@ ISR(USART0_UDRE_vect)
 
 ISR(USART0_RX_vect) 
 {
-	/* Read the character - we ignore the possibility of overrun. */
+	/* Read the character, counting any lost because we were too slow
+	 * to read the one before (the UART's data overrun flag)
+	 */
 	char c;
+	if (UCSR0A & (1 << DOR0))
+	{
+		input_overruns++;
+	}
 	c = UDR0;
 		
-	if (do_echo && bytes_in_out_buffer < OUTPUT_BUFFER_SIZE)
+	if (do_echo)
+	{
+		/* If echoing is enabled, have the UDR empty interrupt handler
+		 * send the character next. (The terminal cursor has then moved
+		 * without terminalio.c seeing it.)
+		 */
+		echo_char = c;
+		UCSR0B |= (1 << UDRIE0);
+		terminal_cursor_lost();
+	}
+
+	/* If the character is a carriage return, turn it into a linefeed */
+	if (c == '\r')
+	{
+		c = '\n';
+	}
+
+	if (input_events)
 	{
-		/* If echoing is enabled and there is output buffer
-		 * space, echo the received character back to the UART.
-		 * (If there is no output buffer space, characters
-		 * will be lost.)
+		/* Hand it on to the event queue (counting it if the queue is
+		 * full), and ask the sender to stop if the queue is getting full
 		 */
-		uart_put_char(c, 0);
+		if (!events_add(EVENT_SERIAL, c))
+		{
+			input_overruns++;
+		}
+		uint8_t waiting = events_waiting();
+		if (waiting > input_high_water)
+		{
+			input_high_water = waiting;
+		}
+		if (waiting >= EVENT_STOP_LEVEL)
+		{
+			stop_input();
+		}
+		return;
 	}
 	
 	/* 
-	 * Check if we have space in our buffer. If not, set the overrun
-	 * flag and throw away the character. (We never clear the 
-	 * overrun flag - it's up to the programmer to check/clear
-	 * this flag if desired.)
+	 * Check if we have space in our buffer. If not, count the overrun
+	 * and throw away the character.
 	 */
-	if (bytes_in_input_buffer >= INPUT_BUFFER_SIZE)
+	uint8_t head = input_head;
+	uint8_t next_head = (head + 1) & INPUT_BUFFER_MASK;
+	if (next_head == input_tail)
 	{
-		input_overrun = 1;
+		input_overruns++;
 	} else
 	{
-		/* If the character is a carriage return, turn it into a
-		 * linefeed 
-		*/
-		if (c == '\r')
-		{
-			c = '\n';
-		}
-		
 		/* 
 		 * There is room in the input buffer 
 		 */
-		input_buffer[input_insert_pos++] = c;
-		bytes_in_input_buffer++;
-		if (input_insert_pos == INPUT_BUFFER_SIZE)
+		input_buffer[head] = c;
+		input_head = next_head;
+		
+		/* Keep statistics, and ask the sender to stop if the buffer
+		 * is getting full
+		 */
+		uint8_t waiting = (next_head - input_tail) & INPUT_BUFFER_MASK;
+		if (waiting > input_high_water)
+		{
+			input_high_water = waiting;
+		}
+		if (waiting >= INPUT_STOP_LEVEL)
 		{
-			/* Wrap around buffer pointer if necessary */
-			input_insert_pos = 0;
+			stop_input();
 		}
 	}
 }
@@ -18,12 +18,22 @@
 
 #include <stdint.h>
 
-/* Initialise serial IO using the UART. baudrate specifies the desired
- * baud rate (e.g. 19200) and echo determines whether incoming characters
- * are echoed back to the UART output as they are received (zero means no
- * echo, non-zero means echo)
+/* Baud rate. This can be set for the build (e.g. -DSERIAL_BAUD=250000).
+ * The baud rate register value and whether to use double speed mode (U2X)
+ * are worked out at compile time, and it is a compile error if the baud
+ * rate can't be made closely enough from the system clock (see
+ * serialio.c). At 8MHz, 19200, 38400, 76800, 250000 and 500000 all work
+ * but 57600 and 115200 don't (they need a 7.3728MHz or 14.7456MHz clock).
  */
-void init_serial_stdio(long baudrate, int8_t echo);
+#ifndef SERIAL_BAUD
+#define SERIAL_BAUD 19200UL
+#endif
+
+/* Initialise serial IO using the UART at SERIAL_BAUD. echo determines
+ * whether incoming characters are echoed back to the UART output as they
+ * are received (zero means no echo, non-zero means echo)
+ */
+void init_serial_stdio(int8_t echo);
 
 /* Test if input is available from the serial port. Return 0 if not,
  * non-zero otherwise. If there is input available then it can be read
@@ -36,5 +46,68 @@ int8_t serial_input_available(void);
  */
 void clear_serial_input_buffer(void);
 
+/* Send received characters to the input event queue (see events.h) as
+ * EVENT_SERIAL events, rather than keeping them for stdio, or (enabled =
+ * 0) go back to keeping them. Any input waiting for stdio is thrown away.
+ * Flow control (below) then works on the event queue - events.c calls
+ * serial_input_taken() whenever an event is taken from it.
+ */
+void serial_set_input_events(uint8_t enabled);
+void serial_input_taken(void);
+
+/* Input statistics: the number of characters lost because they couldn't
+ * be stored (despite flow control - see serialio.c), and the most
+ * characters (or events) there have been waiting to be read. Both are cleared by
+ * serial_clear_input_stats().
+ * Flow control uses XON/XOFF (sent in the middle of other output, and
+ * only while text output is on). Define SERIAL_RTS_BIT to also drive an
+ * RTS line, which works with binary output too. It is a pin of port D
+ * unless SERIAL_RTS_PORT and SERIAL_RTS_DDR are also defined. Port D's
+ * pins are mostly taken (PD0/PD1 by the UART and PD2 upwards by the
+ * matrix panels - see ledmatrix.h), so the spare PA7 is a better choice:
+ * -DSERIAL_RTS_BIT=7 -DSERIAL_RTS_PORT=PORTA -DSERIAL_RTS_DDR=DDRA
+ */
+uint16_t serial_input_overruns(void);
+uint8_t serial_input_high_water(void);
+void serial_clear_input_stats(void);
+
+/* Output a character without going through stdio (as putchar() would,
+ * including sending \n as \r\n). Used by fmt.c.
+ */
+void serial_put_char(char c);
+
+/* Output a block of length characters (from flash for the _P version)
+ * without going through stdio. The characters are copied straight into
+ * the output buffer, a buffer-full at a time (waiting for space as stdio
+ * output does). \n is not turned into \r\n. Used by fmt.c and
+ * terminalio.c.
+ */
+void serial_write(const void* data, uint16_t length);
+void serial_write_P(const void* data, uint16_t length);
+
+/* Non-blocking output. serial_output_space() returns how many characters
+ * can be output now without waiting. serial_try_write() outputs as many
+ * of the length characters of data as it can without waiting and returns
+ * how many it output. (Unlike stdio output, \n is not turned into \r\n.)
+ */
+uint8_t serial_output_space(void);
+uint8_t serial_try_write(const char* data, uint8_t length);
+
+/* Turn text output (through stdio and serial_put_char()) on or off - it
+ * is on after init_serial_stdio(). While it is off text is discarded and
+ * only serial_try_write() sends anything (e.g. binary telemetry, see
+ * telemetry.h). Turning it back on waits for the output buffer to empty.
+ */
+void serial_set_text_output(uint8_t enabled);
+
+/* Output between these goes to the priority lane (see serialio.c), and
+ * can overtake output already waiting to be sent. It is wrapped in
+ * ESC 7 / ESC 8, so it should position the cursor itself and leaves the
+ * cursor and display attributes as they were. Priority messages should be
+ * short (the lane holds 64 characters) and ESC 7 / ESC 8 must not be used
+ * anywhere else.
+ */
+void serial_begin_priority(void);
+void serial_end_priority(void);
 
 #endif /* SERIALIO_H_ */
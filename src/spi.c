@@ -2,10 +2,53 @@
  * spi.c
  *
  * Author: Peter Sutton
+ *
+ * Bytes to be sent are normally placed in a circular transmit queue
+ * which is drained by the SPI Serial Transfer Complete interrupt, so
+ * callers do not have to wait for each byte to be clocked out.
+ * A byte can be followed by a pause (so that a slow slave can keep up).
+ * Timer 2 is used to time pauses.
  */ 
 
 #include "spi.h"
 #include <avr/io.h>
+#include <avr/interrupt.h>
+
+/* The longest pause asked for (1ms, see ledmatrix.c) must fit in 255 ticks */
+#if SPI_PAUSE_TICKS(1000) > 255
+#error "SPI pauses are too long for timer 2 at this F_CPU"
+#endif
+
+/* Timer 2 clock select bits for a pause - system clock divided by 32 */
+#if SPI_PAUSE_TICK_CYCLES != 32
+#error "PAUSE_TIMER_PRESCALER_BITS must match SPI_PAUSE_TICK_CYCLES"
+#endif
+#define PAUSE_TIMER_PRESCALER_BITS ((1 << CS21) | (1 << CS20))
+
+/* Circular buffer holding bytes waiting to be sent. queue_head is the
+ * position the next byte will be written to (only modified outside the
+ * interrupt handler) and queue_tail is the position of the next byte to
+ * be sent (only modified by the interrupt handler once the queue has been
+ * started). SPI_QUEUE_SIZE must be a power of two so that positions can
+ * be wrapped with a mask.
+ */
+#define SPI_QUEUE_SIZE 64
+#define SPI_QUEUE_MASK (SPI_QUEUE_SIZE - 1)
+static volatile uint8_t spi_queue[SPI_QUEUE_SIZE];
+static volatile uint8_t queue_head;
+static volatile uint8_t queue_tail;
+
+/* The pause to make after the byte in each queue position (0 for none).
+ * Written with the byte, so every queued byte can have a pause.
+ */
+static volatile uint8_t pause_ticks[SPI_QUEUE_SIZE];
+
+/* Non-zero while a byte is being clocked out or we are pausing after
+ * one (i.e. while the interrupt handlers still have work to do). When
+ * zero, the next queued byte must be written to SPDR0 by
+ * spi_queue_byte_paced() to restart transmission.
+ */
+static volatile uint8_t transfer_in_progress;
 
 void spi_setup_master(uint8_t clockdivider)
 {
@@ -20,7 +63,9 @@ void spi_setup_master(uint8_t clockdivider)
 	// Set up the SPI control registers SPCR and SPSR:
 	// - SPE bit = 1 (SPI is enabled)
 	// - MSTR bit = 1 (Master Mode)
-	SPCR0 = (1 << SPE0) | (1 << MSTR0);
+	// - SPIE bit = 1 (interrupt when a transfer completes)
+	SPCR0 = (1 << SPE0) | (1 << MSTR0) | (1 << SPIE0);
+	TIMSK2 |= (1 << OCIE2A);
 	
 	// Set SPR0 and SPR1 bits in SPCR and SPI2X bit in SPSR
 	// based on the given clock divider
@@ -52,22 +97,180 @@ void spi_setup_master(uint8_t clockdivider)
 			break;
 	}
 	
+	// Empty the transmit queue
+	queue_head = 0;
+	queue_tail = 0;
+	transfer_in_progress = 0;
+	
+	// Timer 2 times pauses. It is set to clear on compare match (CTC
+	// mode) and is stopped until a pause is needed.
+	TCCR2A = (1 << WGM21);
+	TCCR2B = 0;
+	
 	// Take SS (slave select) line low
 	PORTB &= ~(1 << PORTB4);
 }
 
+// Called when the byte at queue position "position" has been clocked
+// out. Returns non-zero (and starts timer 2) if we need to pause before
+// sending the next byte.
+static uint8_t start_pause_after(uint8_t position)
+{
+	uint8_t ticks = pause_ticks[position];
+	if (ticks == 0)
+	{
+		return 0;
+	}
+	OCR2A = ticks - 1;
+	TCNT2 = 0;
+	TIFR2 = (1 << OCF2A);
+	TCCR2B = PAUSE_TIMER_PRESCALER_BITS;
+	return 1;
+}
+
+// Write the next queued byte to SPDR0, or note that we are finished
+static void send_next_byte(void)
+{
+	if (queue_tail != queue_head)
+	{
+		SPDR0 = spi_queue[queue_tail];
+		queue_tail = (queue_tail + 1) & SPI_QUEUE_MASK;
+	}
+	else
+	{
+		transfer_in_progress = 0;
+	}
+}
+
+// Send the byte at the tail of the queue by hand. Only used when the
+// queue is full and interrupts are disabled (so the interrupt handlers
+// can't make room for us).
+static void send_queued_byte_polled(void)
+{
+	// If we're not already pausing, wait for the byte in progress and
+	// then start a pause if one is needed
+	if (TCCR2B == 0)
+	{
+		while ((SPSR0 & (1 << SPIF0)) == 0)
+		{
+			; // wait for the byte in progress
+		}
+		(void)start_pause_after((queue_tail - 1) & SPI_QUEUE_MASK);
+	}
+	if (TCCR2B != 0)
+	{
+		while ((TIFR2 & (1 << OCF2A)) == 0)
+		{
+			; // wait for the pause to finish
+		}
+		TCCR2B = 0;
+		TIFR2 = (1 << OCF2A);
+	}
+	send_next_byte();
+}
+
+void spi_queue_byte(uint8_t byte)
+{
+	spi_queue_byte_paced(byte, 0);
+}
+
+void spi_queue_byte_paced(uint8_t byte, uint8_t pause)
+{
+	uint8_t next_head = (queue_head + 1) & SPI_QUEUE_MASK;
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	
+	// If the queue is full we wait for the interrupt handler to
+	// take a byte off it. If interrupts are off that will never
+	// happen so we send a byte ourselves.
+	while (next_head == queue_tail)
+	{
+		if (!interrupts_enabled)
+		{
+			send_queued_byte_polled();
+		}
+	}
+	spi_queue[queue_head] = byte;
+	pause_ticks[queue_head] = pause;
+	
+	// Publishing the byte and (re)starting transmission must not be
+	// split by the interrupt handler - it may be just about to decide
+	// the queue is empty and clear transfer_in_progress.
+	cli();
+	queue_head = next_head;
+	if (!transfer_in_progress)
+	{
+		transfer_in_progress = 1;
+		send_next_byte();
+	}
+	if (interrupts_enabled)
+	{
+		sei();
+	}
+}
+
+uint8_t spi_queue_space(void)
+{
+	return (queue_tail - queue_head - 1) & SPI_QUEUE_MASK;
+}
+
+uint8_t spi_busy(void)
+{
+	return transfer_in_progress;
+}
+
+void spi_flush(void)
+{
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	while (transfer_in_progress)
+	{
+		if (!interrupts_enabled)
+		{
+			send_queued_byte_polled();
+		}
+	}
+}
+
 uint8_t spi_send_byte(uint8_t byte)
 {
+	// Wait for anything queued to go first so bytes stay in order.
+	spi_flush();
+	
 	// Write out the byte to the SPDR0 register. This will initiate
 	// the transfer. We then wait until the most significant byte of
 	// SPSR0 (SPIF0 bit) is set - this indicates that the transfer is
 	// complete. (The final read of SPSR0 followed by a read of SPDR0
 	// will cause the SPIF bit to be reset to 0. See page 173 of the 
-	// ATmega324A datasheet.)
+	// ATmega324A datasheet.) The transfer complete interrupt is
+	// disabled while we do this so that it doesn't clear SPIF0 first.
+	SPCR0 &= ~(1 << SPIE0);
 	SPDR0 = byte;
 	while ((SPSR0 & (1 << SPIF0)) == 0)
 	{
 		; // wait
 	}
-	return SPDR0;
+	byte = SPDR0;
+	SPCR0 |= (1 << SPIE0);
+	return byte;
+}
+
+/*
+ * Interrupt handler for SPI Serial Transfer Complete - the byte that was
+ * in SPDR0 has gone so we send the next one from the queue (if any),
+ * unless we have to pause first.
+ */
+ISR(SPI_STC_vect)
+{
+	if (!start_pause_after((queue_tail - 1) & SPI_QUEUE_MASK))
+	{
+		send_next_byte();
+	}
+}
+
+/*
+ * Interrupt handler for timer 2 compare match - the end of a pause.
+ */
+ISR(TIMER2_COMPA_vect)
+{
+	TCCR2B = 0;	// stop the timer
+	send_next_byte();
 }
@@ -8,13 +8,48 @@
 #define SPI_H_
 
 #include <stdint.h>
+#include "clock.h"
 
 // Set up SPI communication as a master.
 // clockdivider should be one of 2,4,8,16,32,64,128
+// Interrupts must be enabled globally for the queued functions below
+// to return without waiting.
 void spi_setup_master(uint8_t clockdivider);
 
-// Send and receive an SPI byte. This function will take at least 8 
-// cyles of the divided clock (i.e. will busy wait).
+// Pauses between bytes are measured in ticks of timer 2, which runs at
+// the system clock divided by 32 during a pause (4us per tick with an
+// 8MHz clock). SPI_PAUSE_TICKS() converts microseconds to ticks (rounding
+// up) - pauses can be at most 255 ticks. SPI_PAUSE_TICKS_US() converts
+// ticks back to microseconds.
+#define SPI_PAUSE_TICK_CYCLES 32
+#define SPI_PAUSE_TICKS(us) \
+		(((us) * (F_CPU / 1000000UL) + SPI_PAUSE_TICK_CYCLES - 1) \
+		/ SPI_PAUSE_TICK_CYCLES)
+#define SPI_PAUSE_TICKS_US(ticks) \
+		((ticks) * SPI_PAUSE_TICK_CYCLES / (F_CPU / 1000000UL))
+
+// Add a byte to the transmit queue and return immediately. The byte is
+// sent by the SPI transfer complete interrupt once the bytes ahead of it
+// have gone. If the queue is full this will wait until there is room.
+void spi_queue_byte(uint8_t byte);
+
+// As above, but the next byte isn't sent until pause ticks (see above)
+// after this one has been clocked out. A pause of 0 means no pause.
+void spi_queue_byte_paced(uint8_t byte, uint8_t pause);
+
+// Return the number of bytes that can be queued without waiting.
+uint8_t spi_queue_space(void);
+
+// Return non-zero if queued bytes are still being sent (or we are still
+// pausing after the last one).
+uint8_t spi_busy(void);
+
+// Wait until every queued byte has been sent.
+void spi_flush(void);
+
+// Send and receive an SPI byte. Any queued bytes are sent first. This
+// function will take at least 8 cyles of the divided clock (i.e. will
+// busy wait).
 uint8_t spi_send_byte(uint8_t byte);
 
 #endif /* SPI_H_ */
@@ -0,0 +1,90 @@
+/*
+ * telemetry.c
+ *
+ * Binary telemetry frames - see telemetry.h.
+ */
+
+#include "telemetry.h"
+#include <stdint.h>
+#include "serialio.h"
+
+#define FRAME_START 0x7E
+
+// Bytes in a frame other than the payload
+#define FRAME_OVERHEAD 5
+
+static uint8_t mode;
+static uint8_t sequence;
+
+void telemetry_init(void)
+{
+	sequence = 0;
+	telemetry_set_mode(TELEMETRY_MODE);
+}
+
+void telemetry_set_mode(uint8_t new_mode)
+{
+	mode = new_mode;
+	serial_set_text_output(mode != TELEMETRY_ONLY);
+}
+
+uint8_t telemetry_mode(void)
+{
+	return mode;
+}
+
+static char hex_digit(uint8_t value)
+{
+	return (value < 10) ? '0' + value : 'A' + value - 10;
+}
+
+void telemetry_send(uint8_t type, const uint8_t* payload, uint8_t length)
+{
+	if (mode == TELEMETRY_OFF)
+	{
+		return;
+	}
+	
+	uint8_t frame[FRAME_OVERHEAD + TELEMETRY_MAX_PAYLOAD];
+	uint8_t frame_length = 0;
+	frame[frame_length++] = FRAME_START;
+	frame[frame_length++] = length;
+	frame[frame_length++] = sequence++;
+	frame[frame_length++] = type;
+	for (uint8_t i = 0; i < length; i++)
+	{
+		frame[frame_length++] = payload[i];
+	}
+	uint8_t sum = 0;
+	for (uint8_t i = 1; i < frame_length; i++)
+	{
+		sum += frame[i];
+	}
+	frame[frame_length++] = -sum;
+	
+	// Send the whole frame or none of it
+	if (mode == TELEMETRY_ONLY)
+	{
+		if (serial_output_space() >= frame_length)
+		{
+			serial_try_write((const char*)frame, frame_length);
+		}
+		return;
+	}
+	char text[3 + 2 * sizeof(frame) + 2];
+	uint8_t text_length = 0;
+	text[text_length++] = '\x1b';
+	text[text_length++] = '_';
+	text[text_length++] = 'T';
+	for (uint8_t i = 0; i < frame_length; i++)
+	{
+		text[text_length++] = hex_digit(frame[i] >> 4);
+		text[text_length++] = hex_digit(frame[i] & 0x0F);
+	}
+	text[text_length++] = '\x1b';
+	text[text_length++] = '\\';
+	if (serial_output_space() >= text_length)
+	{
+		serial_try_write(text, text_length);
+	}
+}
@@ -0,0 +1,61 @@
+/*
+ * telemetry.h
+ *
+ * Binary telemetry of the game state over the serial port, so that a
+ * program on the host can follow a game without reading the terminal
+ * display. Each event (a shot, a ship sunk, ...) is sent as a frame:
+ *
+ *	0x7E, length, sequence, type, payload (length bytes), checksum
+ *
+ * The sequence number goes up by one for every frame, so the host can see
+ * when frames are lost (a frame is dropped, rather than waited for, if
+ * there isn't room for it in the serial output buffer). The checksum makes
+ * the sum of all bytes from length to checksum a multiple of 256.
+ *
+ * TELEMETRY_ALONGSIDE sends each frame inside an application program
+ * command (ESC _ T, the frame as hex digits, ESC \), which terminals
+ * ignore, so it can be used with the normal terminal display.
+ * TELEMETRY_ONLY sends frames as they are and turns off all text output.
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdint.h>
+
+#define TELEMETRY_OFF 0
+#define TELEMETRY_ALONGSIDE 1
+#define TELEMETRY_ONLY 2
+
+// Mode set by telemetry_init() (can be set for the build)
+#ifndef TELEMETRY_MODE
+#define TELEMETRY_MODE TELEMETRY_OFF
+#endif
+
+// Frame types and their payloads. turn is 0 for the human, 1 for the
+// computer.
+#define TELEMETRY_GAME_START 1	// salvo_mode, computer_mode
+#define TELEMETRY_FIRE 2		// turn, x, y, cell (grid byte after the shot)
+#define TELEMETRY_TURN 3		// turn (just completed), unfired cells left on
+								// the human grid and on the computer grid,
+								// salvo shot limit
+#define TELEMETRY_SUNK 4		// turn (who sunk it), ship type
+#define TELEMETRY_CURSOR 5		// x, y
+#define TELEMETRY_MODES 6		// bit 0 salvo mode, bit 1 search and destroy,
+								// bit 2 cheat visible, bits 3-4 colour theme
+#define TELEMETRY_GAME_OVER 7	// winner (1 human, 2 computer)
+
+// Longest payload
+#define TELEMETRY_MAX_PAYLOAD 4
+
+// Set the mode to TELEMETRY_MODE. Must be called after init_serial_stdio().
+void telemetry_init(void);
+
+void telemetry_set_mode(uint8_t mode);
+uint8_t telemetry_mode(void);
+
+// Send a frame (if telemetry is on). length must be at most
+// TELEMETRY_MAX_PAYLOAD.
+void telemetry_send(uint8_t type, const uint8_t* payload, uint8_t length);
+
+#endif /* TELEMETRY_H_ */
@@ -2,72 +2,629 @@
  * terminalio.c
  *
  * Author: Peter Sutton
+ *
+ * We keep a shadow copy of some of the status rows (those rewritten
+ * during a game) so that set_terminal_line() only has to send the
+ * characters which change. The shadow only covers as many columns as the
+ * longest text shown on that row, see shadow_width. A row's shadow is
+ * only trusted while its bit in shadow_valid is set - writing to the
+ * row any other way (via move_terminal_cursor()) clears the bit.
+ *
+ * If the serial output buffer is too full to take a status row without
+ * waiting, the new text is just put in the row's shadow and the row is
+ * marked stale. terminal_service() sends stale rows once there is room,
+ * so a row changed several times while the buffer is full is only sent
+ * once, with its latest text.
+ *
+ * We also follow where the terminal's cursor is by watching every
+ * character sent (serialio.c passes them to terminal_output_char()), so
+ * that a cursor movement can use the shortest escape sequence which gets
+ * there - often nothing at all, a carriage return or a relative move
+ * rather than a full ESC[y;xH. Escape sequences are written with fmt.c
+ * rather than printf.
+ *
+ * Status rows are only cleared as far as STATUS_COLUMNS (with ESC[nX
+ * rather than ESC[K), so other things can be shown to the right of them.
  */
 
 #include "terminalio.h"
-#include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <avr/pgmspace.h>
+#include "fmt.h"
+#include "serialio.h"
+
+// Number of columns kept for each row (1 to SHADOW_ROWS), 0 for rows
+// without a shadow
+#define SHADOW_ROWS 20
+static const uint8_t shadow_width[SHADOW_ROWS + 1] PROGMEM =
+{
+	[1] = 24,	// invalid move message
+	[11] = 12,	// game paused
+	[16] = 17,	// score
+	[17] = 35,	// computer mode
+	[18] = 15,	// salvo mode
+	[20] = 26	// colour theme
+};
+#define SHADOW_SIZE (24 + 12 + 17 + 35 + 15 + 26)
+static char shadow[SHADOW_SIZE];
+static uint32_t shadow_valid;
+static uint32_t shadow_stale;
+
+// Most bytes needed to rewrite a status row, beyond the row's width
+// (cursor movement and ESC[nX)
+#define ROW_OVERHEAD 14
+
+// A relative move along a row costs about this many bytes, so gaps of
+// unchanged characters up to this long are rewritten rather than moved over
+#define MOVE_COST 4
+
+// We assume the terminal is at least this wide (the start screen banner
+// needs 108 columns). The cursor position is forgotten if a write goes
+// past it (the terminal may have wrapped).
+#define TERMINAL_WIDTH 132
+
+// Terminal cursor position after the characters sent so far (cursor_y is
+// 0 if we don't know where it is) and the position saved by ESC 7.
+// cursor_lost is set if characters were sent from an interrupt.
+static uint8_t cursor_x, cursor_y;
+static uint8_t saved_x, saved_y;
+static volatile uint8_t cursor_lost;
+
+// Escape sequence being sent: state, numeric parameters (at most two are
+// used) and whether it is a private (ESC[?) sequence
+#define ESC_NONE 0
+#define ESC_START 1
+#define ESC_CSI 2
+#define ESC_STRING 3
+#define ESC_STRING_END 4
+static uint8_t escape_state;
+static uint8_t escape_params[2];
+static uint8_t escape_param_count;
+static uint8_t escape_private;
+
+static uint8_t row_width(int y)
+{
+	return (y > 0 && y <= SHADOW_ROWS) ? pgm_read_byte(&shadow_width[y]) : 0;
+}
+
+// Position of the start of a row in shadow (the row must have a shadow)
+static char* row_shadow(uint8_t y)
+{
+	uint16_t offset = 0;
+	for (uint8_t row = 1; row < y; row++)
+	{
+		offset += pgm_read_byte(&shadow_width[row]);
+	}
+	return &shadow[offset];
+}
+
+static void send_move(int x, int y);
+static void clear_status_row(void);
+
+// Rewrite a stale row from its shadow, up to the last non-blank
+static void send_stale_row(uint8_t y)
+{
+	char* row = row_shadow(y);
+	uint8_t length = row_width(y);
+	while (length > 0 && row[length - 1] == ' ')
+	{
+		length--;
+	}
+	send_move(1, y);
+	clear_status_row();
+	serial_write(row, length);
+	shadow_valid |= (uint32_t)1 << y;
+	shadow_stale &= ~((uint32_t)1 << y);
+}
+
+static void forget_cursor(void)
+{
+	cursor_y = 0;
+}
+
+// Update the cursor position for the end of a CSI sequence
+static void csi_final(char c)
+{
+	uint8_t n = escape_params[0] ? escape_params[0] : 1;
+	if (escape_private)
+	{
+		return;		// ESC[?25l etc. leave the cursor alone
+	}
+	switch (c)
+	{
+		case 'H':
+		case 'f':
+			cursor_y = n;
+			cursor_x = escape_params[1] ? escape_params[1] : 1;
+			break;
+		case 'A':
+			cursor_y = (cursor_y > n) ? cursor_y - n : (cursor_y ? 1 : 0);
+			break;
+		case 'B':
+			cursor_y = (cursor_y && cursor_y + n <= UINT8_MAX) ?
+					cursor_y + n : 0;
+			break;
+		case 'C':
+		case 'b':	// REP - the last character is repeated n times
+			if (cursor_x + n <= TERMINAL_WIDTH)
+			{
+				cursor_x += n;
+			}
+			else
+			{
+				forget_cursor();	// stopped at the right margin
+			}
+			break;
+		case 'D':
+			cursor_x = (cursor_x > n) ? cursor_x - n : 1;
+			break;
+		case 'r':
+			// Setting the scroll region homes the cursor
+			cursor_x = cursor_y = 1;
+			break;
+		case 'J':
+		case 'K':
+		case 'X':
+		case 'm':
+			break;
+		default:
+			forget_cursor();
+			break;
+	}
+}
+
+void terminal_output_char(char c)
+{
+	// Strings (ESC _ ... ESC \ etc.) don't move the cursor
+	if (escape_state == ESC_STRING)
+	{
+		if (c == '\x1b')
+		{
+			escape_state = ESC_STRING_END;
+		}
+		return;
+	}
+	if (escape_state == ESC_STRING_END)
+	{
+		escape_state = (c == '\\') ? ESC_NONE : ESC_STRING;
+		return;
+	}
+	if (escape_state == ESC_CSI)
+	{
+		if (c >= '0' && c <= '9')
+		{
+			if (escape_param_count < 2)
+			{
+				uint8_t* param = &escape_params[escape_param_count];
+				*param = (*param < 25) ? *param * 10 + (c - '0') : UINT8_MAX;
+			}
+		}
+		else if (c == ';')
+		{
+			escape_param_count++;
+		}
+		else if (c == '?')
+		{
+			escape_private = 1;
+		}
+		else if (c >= 0x40 && c <= 0x7e)
+		{
+			csi_final(c);
+			escape_state = ESC_NONE;
+		}
+		return;
+	}
+	if (escape_state == ESC_START)
+	{
+		escape_state = ESC_NONE;
+		if (c == '[')
+		{
+			escape_state = ESC_CSI;
+			escape_params[0] = escape_params[1] = 0;
+			escape_param_count = 0;
+			escape_private = 0;
+		}
+		else if (c == '_' || c == ']' || c == 'P')
+		{
+			escape_state = ESC_STRING;
+		}
+		else if (c == '7')
+		{
+			saved_x = cursor_x;
+			saved_y = cursor_y;
+		}
+		else if (c == '8')
+		{
+			cursor_x = saved_x;
+			cursor_y = saved_y;
+		}
+		else
+		{
+			// ESC D, ESC M etc. may scroll rather than move
+			forget_cursor();
+		}
+		return;
+	}
+	if (c == '\x1b')
+	{
+		escape_state = ESC_START;
+	}
+	else if (c == '\r')
+	{
+		cursor_x = 1;
+	}
+	else if (c == '\n')
+	{
+		// Assume this doesn't scroll (we don't print at the bottom of the
+		// screen except in scroll regions, which go through ESC D)
+		if (cursor_y)
+		{
+			cursor_y++;
+		}
+	}
+	else if (c == '\b')
+	{
+		if (cursor_x > 1)
+		{
+			cursor_x--;
+		}
+	}
+	else if ((uint8_t)c >= ' ' && c != 0x7f)
+	{
+		if (++cursor_x > TERMINAL_WIDTH)
+		{
+			forget_cursor();
+		}
+	}
+}
+
+void terminal_cursor_lost(void)
+{
+	cursor_lost = 1;
+}
+
+static uint8_t decimal_length(uint8_t n)
+{
+	return (n < 10) ? 1 : (n < 100) ? 2 : 3;
+}
+
+// Length of ESC[nc (the count is left out when it is 1, see fmt_csi())
+static uint8_t csi_length(uint8_t n)
+{
+	return (n == 1) ? 3 : 3 + decimal_length(n);
+}
+
+static void send_move(int x, int y)
+{
+	uint8_t column = (x < 1) ? 1 : (x > UINT8_MAX) ? UINT8_MAX : x;
+	uint8_t row = (y < 1) ? 1 : (y > UINT8_MAX) ? UINT8_MAX : y;
+	if (cursor_lost)
+	{
+		cursor_lost = 0;
+		forget_cursor();
+	}
+	
+	// Absolute move: ESC[y;xH, ESC[yH or ESC[H
+	uint8_t absolute = 3;
+	if (column > 1)
+	{
+		absolute += decimal_length(row) + 1 + decimal_length(column);
+	}
+	else if (row > 1)
+	{
+		absolute += decimal_length(row);
+	}
+	
+	if (cursor_y)
+	{
+		// Relative move: up or down, then along the row (possibly by
+		// going back to the start of the row first)
+		uint8_t vertical = 0;
+		if (row != cursor_y)
+		{
+			vertical = csi_length((row > cursor_y) ?
+					row - cursor_y : cursor_y - row);
+		}
+		uint8_t horizontal = 0;
+		uint8_t from_start = 0;
+		if (column > cursor_x)
+		{
+			horizontal = csi_length(column - cursor_x);
+		}
+		else if (column < cursor_x)
+		{
+			horizontal = csi_length(cursor_x - column);
+			uint8_t length = 1 + ((column > 1) ? csi_length(column - 1) : 0);
+			if (length <= horizontal)
+			{
+				horizontal = length;
+				from_start = 1;
+			}
+		}
+		if (vertical + horizontal < absolute)
+		{
+			if (row > cursor_y)
+			{
+				fmt_csi(row - cursor_y, 'B');
+			}
+			else if (row < cursor_y)
+			{
+				fmt_csi(cursor_y - row, 'A');
+			}
+			if (from_start)
+			{
+				serial_put_char('\r');
+				if (column > 1)
+				{
+					fmt_csi(column - 1, 'C');
+				}
+			}
+			else if (column > cursor_x)
+			{
+				fmt_csi(column - cursor_x, 'C');
+			}
+			else if (column < cursor_x)
+			{
+				fmt_csi(cursor_x - column, 'D');
+			}
+			return;
+		}
+	}
+	
+	if (column > 1)
+	{
+		fmt_csi2(row, column, 'H');
+	}
+	else
+	{
+		fmt_csi(row, 'H');
+	}
+}
 
 // Move terminal cursor to location. First row is y=1
 void move_terminal_cursor(int x, int y)
 {
-    printf_P(PSTR("\x1b[%d;%dH"), y, x);
+	// Anything could be written to the row now (the terminal treats
+	// row 0 as row 1), so it must be up to date first - unless the
+	// cursor is past the status columns
+	uint8_t row = (y < 1) ? 1 : y;
+	if (row_width(row) && x <= STATUS_COLUMNS)
+	{
+		if (shadow_stale & ((uint32_t)1 << row))
+		{
+			send_stale_row(row);
+		}
+		shadow_valid &= ~((uint32_t)1 << row);
+	}
+	send_move(x, y);
+}
+
+// Character at column x (1 is the first column) of a status row which
+// shows text (of length length) from column start
+static char line_char(uint8_t x, uint8_t start, const char* text,
+		uint8_t length, uint8_t in_flash)
+{
+	if (x < start || x - start >= length)
+	{
+		return ' ';
+	}
+	return in_flash ? pgm_read_byte(&text[x - start]) : text[x - start];
+}
+
+static void set_line(int x, int y, const char* text, uint8_t in_flash)
+{
+	if (x < 1)
+	{
+		x = 1;
+	}
+	if (y < 1)
+	{
+		y = 1;
+	}
+	uint8_t width = row_width(y);
+	uint8_t length = in_flash ? strlen_P(text) : strlen(text);
+	if (x - 1 + length > width)
+	{
+		length = (x - 1 < width) ? width - (x - 1) : 0;
+	}
+	uint32_t row_bit = width ? (uint32_t)1 << y : 0;
+	if (width && serial_output_space() < width + ROW_OVERHEAD)
+	{
+		// No room to send it now - leave it for terminal_service()
+		char* row = row_shadow(y);
+		for (uint8_t column = 1; column <= width; column++)
+		{
+			row[column - 1] = line_char(column, x, text, length, in_flash);
+		}
+		shadow_stale |= row_bit;
+		return;
+	}
+	if (width == 0 || !(shadow_valid & row_bit) || (shadow_stale & row_bit))
+	{
+		// Rewrite the whole row
+		send_move(1, y);
+		clear_status_row();
+		if (width == 0)
+		{
+			send_move(x, y);
+			if (in_flash)
+			{
+				fmt_string_P(text);
+			}
+			else
+			{
+				fmt_string(text);
+			}
+			return;
+		}
+		char* row = row_shadow(y);
+		for (uint8_t column = 1; column <= width; column++)
+		{
+			row[column - 1] = ' ';
+		}
+		shadow_valid |= row_bit;
+		shadow_stale &= ~row_bit;
+	}
+	
+	// Send the characters which differ. cursor is the column the cursor
+	// is in (0 if it isn't on this row).
+	char* row = row_shadow(y);
+	uint8_t cursor = 0;
+	uint8_t last_text_column = (length > 0) ? x + length - 1 : 0;
+	for (uint8_t column = 1; column <= width; column++)
+	{
+		char c = line_char(column, x, text, length, in_flash);
+		if (row[column - 1] == c)
+		{
+			continue;
+		}
+		if (column > last_text_column)
+		{
+			// Only blanks from here on - clear the rest of the row
+			if (cursor != column)
+			{
+				send_move(column, y);
+			}
+			clear_status_row();
+			for (; column <= width; column++)
+			{
+				row[column - 1] = ' ';
+			}
+			break;
+		}
+		if (cursor == 0 || column - cursor > MOVE_COST)
+		{
+			send_move(column, y);
+			cursor = column;
+		}
+		// Rewrite any unchanged characters between the cursor and here
+		for (; cursor <= column; cursor++)
+		{
+			serial_put_char(row[cursor - 1] = line_char(cursor, x, text, length,
+					in_flash));
+		}
+	}
+}
+
+void set_terminal_line(int x, int y, const char* text)
+{
+	set_line(x, y, text, 0);
+}
+
+void set_terminal_line_P(int x, int y, const char* text)
+{
+	set_line(x, y, text, 1);
+}
+
+void terminal_service(void)
+{
+	for (uint8_t y = 1; shadow_stale && y <= SHADOW_ROWS; y++)
+	{
+		if (shadow_stale & ((uint32_t)1 << y))
+		{
+			if (serial_output_space() < row_width(y) + ROW_OVERHEAD)
+			{
+				return;
+			}
+			send_stale_row(y);
+		}
+	}
+}
+
+uint8_t terminal_rows_waiting(void)
+{
+	return shadow_stale != 0;
+}
+
+void begin_priority_output(void)
+{
+	serial_begin_priority();
+	// The message is sent from wherever the terminal's cursor is then
+	// (which isn't known), and the ESC 8 at its end puts the cursor back.
+	// It may also be sent in the middle of coloured output - the ESC 8
+	// puts the colours back as well.
+	forget_cursor();
+	normal_display_mode();
+}
+
+void end_priority_output(void)
+{
+	serial_end_priority();
 }
 
 void normal_display_mode(void)
 {
-	printf_P(PSTR("\x1b[0m"));
+	fmt_string_P(PSTR("\x1b[0m"));
 }
 
 void reverse_video(void)
 {
-	printf_P(PSTR("\x1b[7m"));
+	fmt_string_P(PSTR("\x1b[7m"));
 }
 
 void clear_terminal(void)
 {
-	printf_P(PSTR("\x1b[2J"));
+	fmt_string_P(PSTR("\x1b[2J"));
+	// The shadowed rows are now known to be blank
+	for (uint16_t i = 0; i < SHADOW_SIZE; i++)
+	{
+		shadow[i] = ' ';
+	}
+	shadow_valid = ~(uint32_t)0;
+	shadow_stale = 0;
 }
 
 void clear_to_end_of_line(void)
 {
-	printf_P(PSTR("\x1b[K"));
+	fmt_string_P(PSTR("\x1b[K"));
+}
+
+// Clear from the cursor (which must be known) to the end of the status
+// columns, leaving the rest of the row alone
+static void clear_status_row(void)
+{
+	if (cursor_y && cursor_x <= STATUS_COLUMNS)
+	{
+		fmt_csi(STATUS_COLUMNS + 1 - cursor_x, 'X');
+	}
 }
 
 void set_display_attribute(DisplayParameter parameter)
 {
-	printf_P(PSTR("\x1b[%dm"), parameter);
+	fmt_string_P(PSTR("\x1b["));
+	fmt_u8(parameter);
+	serial_put_char('m');
 }
 
 void hide_cursor()
 {
-	printf_P(PSTR("\x1b[?25l"));
+	fmt_string_P(PSTR("\x1b[?25l"));
 }
 
 void show_cursor()
 {
-	printf_P(PSTR("\x1b[?25h"));
+	fmt_string_P(PSTR("\x1b[?25h"));
 }
 
 void enable_scrolling_for_whole_display(void)
 {
-	printf_P(PSTR("\x1b[r"));
+	fmt_string_P(PSTR("\x1b[r"));
 }
 
 void set_scroll_region(int8_t y1, int8_t y2)
 {
-	printf_P(PSTR("\x1b[%d;%dr"), y1, y2);
+	fmt_csi2(y1, y2, 'r');
 }
 
 void scroll_down(void)
 {
-	printf_P(PSTR("\x1bM"));	// ESC-M
+	fmt_string_P(PSTR("\x1bM"));	// ESC-M
 }
 
 void scroll_up(void)
 {
-	printf_P(PSTR("\x1b\x44"));	// ESC-D
+	fmt_string_P(PSTR("\x1b\x44"));	// ESC-D
 }
 
 void draw_horizontal_line(int8_t y, int8_t start_x, int8_t end_x)
@@ -76,10 +633,7 @@ void draw_horizontal_line(int8_t y, int8_t start_x, int8_t end_x)
 	reverse_video();
 	for (int8_t i = start_x; i <= end_x; i++)
 	{
-		printf(" ");	/* No need to use printf_P - printing 
-						 * a single character gets optimised
-						 * to a putchar call 
-						 */
+		serial_put_char(' ');
 	}
 	normal_display_mode();
 }
@@ -90,10 +644,10 @@ void draw_vertical_line(int8_t x, int8_t start_y, int8_t end_y)
 	reverse_video();
 	for(int8_t i = start_y; i < end_y; i++)
 	{
-		printf(" ");
+		serial_put_char(' ');
 		/* Move down one and back to the left one */
-		printf_P(PSTR("\x1b[B\x1b[D"));
+		fmt_string_P(PSTR("\x1b[B\x1b[D"));
 	}
-	printf(" ");
+	serial_put_char(' ');
 	normal_display_mode();
 }
@@ -64,6 +64,43 @@ void set_display_attribute(DisplayParameter parameter);
 void hide_cursor(void);
 void show_cursor(void);
 
+// Status rows only use the first STATUS_COLUMNS columns of the terminal,
+// the rest of each row is left alone
+#define STATUS_COLUMNS 56
+
+// Status rows. Make row y show text starting at column x, and nothing
+// else (a column or row of 0 is treated as 1). Some status rows have a
+// shadow copy of what the terminal is showing (see terminalio.c), and
+// only the characters which have changed are sent to those rows. Text
+// must fit in the row's shadow - anything past it is cut off. Rows without
+// a shadow are cleared and rewritten in full. The _P version takes text
+// in flash (PSTR()).
+// move_terminal_cursor() can be used to write to a status row directly,
+// the row is then rewritten in full the next time it is set.
+// Shadowed rows never wait for room in the serial output buffer - if it
+// is too full the row is sent later by terminal_service(), which should
+// be called regularly.
+void set_terminal_line(int x, int y, const char* text);
+void set_terminal_line_P(int x, int y, const char* text);
+void terminal_service(void);
+
+// Return non-zero if any status rows are waiting for terminal_service()
+uint8_t terminal_rows_waiting(void);
+
+// Output between these (e.g. a move_terminal_cursor() and some text) is
+// sent ahead of other output waiting to be sent, and leaves the cursor
+// and display attributes as they were (see serial_begin_priority()).
+// For short, important messages.
+void begin_priority_output(void);
+void end_priority_output(void);
+
+// Called by serialio.c for every character sent to the terminal so that
+// we can follow where the cursor is. terminal_cursor_lost() is called
+// instead for characters sent from an interrupt (input echo) or thrown
+// away - the next cursor movement is then absolute.
+void terminal_output_char(char c);
+void terminal_cursor_lost(void);
+
 // Enable scrolling for either the full screen or a particular region (rows)
 // For set_scroll_region y1 < y2 and the region includes rows y1 and y2.
 void enable_scrolling_for_whole_display(void);
@@ -9,6 +9,8 @@
  */
 
 #include "timer0.h"
+#include "clock.h"
+#include "buttons.h"
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
@@ -16,11 +18,17 @@
  * millisecond. Will overflow every ~49 days. */
 static volatile uint32_t clock_ticks_ms;
 
+/* Output compare value for a 1ms period with the clock divided by 64 */
+#define TIMER0_TOP (F_CPU / 64 / 1000 - 1)
+#if F_CPU % 64000 != 0 || TIMER0_TOP > 255
+#error "timer 0 can't count milliseconds exactly at this F_CPU"
+#endif
+
 /* Set up timer 0 to generate an interrupt every 1ms. 
- * We will divide the clock by 64 and count up to 124.
+ * We will divide the clock by 64 and count up to 124
+ * (with an 8MHz clock - TIMER0_TOP in general).
  * We will therefore get an interrupt every 64 x 125
- * clock cycles, i.e. every 1 milliseconds with an 8MHz
- * clock. 
+ * clock cycles, i.e. every 1 milliseconds. 
  * The counter will be reset to 0 when it reaches it's
  * output compare value.
  */
@@ -34,8 +42,8 @@ void init_timer0(void)
 	/* Clear the timer */
 	TCNT0 = 0;
 
-	/* Set the output compare value to be 124 */
-	OCR0A = 124;
+	/* Set the output compare value (124 at 8MHz) */
+	OCR0A = TIMER0_TOP;
 	
 	/* Set the timer to clear on compare match (CTC mode)
 	 * and to divide the clock by 64. This starts the timer
@@ -79,4 +87,7 @@ ISR(TIMER0_COMPA_vect)
 {
 	/* Increment our clock tick count */
 	clock_ticks_ms++;
+
+	/* Sample the buttons (every few ticks) */
+	buttons_sample();
 }
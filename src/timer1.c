@@ -3,7 +3,7 @@
  *
  * Author: Peter Sutton
  *
- * timer 1 skeleton
+ * timer 1 skeleton (timer 1 is used by dither.c - see timer1.h)
  */
 
 #include "timer1.h"
@@ -4,6 +4,9 @@
  * Author: Peter Sutton
  *
  * timer 1 skeleton
+ *
+ * Note: timer 1 is used by dither.c to time dithering sub-frames, so it
+ * shouldn't be used for anything else once dither_init() has been called.
  */
 
 #ifndef TIMER1_H_
@@ -3,7 +3,7 @@
  *
  * Author: Peter Sutton
  *
- * timer 2 skeleton
+ * timer 2 skeleton (timer 2 is used by spi.c - see timer2.h)
  */
 
 #include "timer2.h"
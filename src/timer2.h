@@ -4,6 +4,9 @@
  * Author: Peter Sutton
  *
  * timer 2 skeleton
+ *
+ * Note: timer 2 is used by spi.c to time pauses between SPI bytes, so
+ * it shouldn't be used for anything else while the LED matrix is in use.
  */
 
 #ifndef TIMER2_H_
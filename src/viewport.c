@@ -0,0 +1,213 @@
+/*
+ * viewport.c
+ *
+ * Pans a panel sized window around a larger board - see viewport.h.
+ */
+
+#include "viewport.h"
+#include <stdint.h>
+#include "ledmatrix.h"
+#include "palette.h"
+
+// SPI bytes for a one step pan, and for redrawing the whole viewport.
+// (A shift is 2 bytes, a column 10 bytes and a row 18 bytes.)
+#define PAN_COLUMN_COST	(2 + 2 + MATRIX_NUM_ROWS)
+#define PAN_ROW_COST	(2 + 2 + MATRIX_NUM_COLUMNS)
+#define REDRAW_COST		(1 + MATRIX_NUM_COLUMNS * MATRIX_NUM_ROWS)
+
+static uint8_t panel;
+static uint8_t width;
+static uint8_t height;
+static ViewportSource get_cell;
+
+// Board position of the bottom left corner of the viewport
+static uint8_t origin_x;
+static uint8_t origin_y;
+
+// Largest values origin_x and origin_y can take
+static uint8_t max_x;
+static uint8_t max_y;
+
+static PaletteIndex board_cell(uint8_t x, uint8_t y)
+{
+	if (x >= width || y >= height)
+	{
+		return PALETTE_BLACK;
+	}
+	return get_cell(x, y);
+}
+
+// Draw panel column x from the board
+static void draw_column(uint8_t x)
+{
+	PaletteMatrixColumn column;
+	for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++)
+	{
+		palette_matrix_column_set(column, y,
+				board_cell(origin_x + x, origin_y + y));
+	}
+	ledmatrix_update_column_palette(x, column);
+}
+
+// Draw panel row y from the board
+static void draw_row(uint8_t y)
+{
+	ledmatrix_begin_batch();
+	for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++)
+	{
+		ledmatrix_update_pixel_index(x, y,
+				board_cell(origin_x + x, origin_y + y));
+	}
+	ledmatrix_end_batch();
+}
+
+static void redraw(void)
+{
+	ledmatrix_begin_batch();
+	for (uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++)
+	{
+		draw_column(x);
+	}
+	ledmatrix_end_batch();
+}
+
+// Pan by one column or row. The matrix shifts its contents the opposite
+// way to the viewport, and we fill in the edge that is exposed.
+static void step_right(void)
+{
+	origin_x++;
+	ledmatrix_shift_display_left();
+	draw_column(MATRIX_NUM_COLUMNS - 1);
+}
+
+static void step_left(void)
+{
+	origin_x--;
+	ledmatrix_shift_display_right();
+	draw_column(0);
+}
+
+static void step_up(void)
+{
+	origin_y++;
+	ledmatrix_shift_display_down();
+	draw_row(MATRIX_NUM_ROWS - 1);
+}
+
+static void step_down(void)
+{
+	origin_y--;
+	ledmatrix_shift_display_up();
+	draw_row(0);
+}
+
+void viewport_init(uint8_t panel_number, uint8_t board_width,
+		uint8_t board_height, ViewportSource source)
+{
+	panel = panel_number;
+	width = board_width;
+	height = board_height;
+	get_cell = source;
+	max_x = (width > MATRIX_NUM_COLUMNS) ? width - MATRIX_NUM_COLUMNS : 0;
+	max_y = (height > MATRIX_NUM_ROWS) ? height - MATRIX_NUM_ROWS : 0;
+	origin_x = 0;
+	origin_y = 0;
+	viewport_draw();
+}
+
+void viewport_draw(void)
+{
+	uint8_t previous_panel = ledmatrix_selected_panel();
+	ledmatrix_select_panel(panel);
+	redraw();
+	ledmatrix_select_panel(previous_panel);
+}
+
+void viewport_draw_cell(uint8_t x, uint8_t y)
+{
+	if (x < origin_x || x - origin_x >= MATRIX_NUM_COLUMNS
+			|| y < origin_y || y - origin_y >= MATRIX_NUM_ROWS)
+	{
+		// Not in view
+		return;
+	}
+	uint8_t previous_panel = ledmatrix_selected_panel();
+	ledmatrix_select_panel(panel);
+	ledmatrix_update_pixel_index(x - origin_x, y - origin_y, board_cell(x, y));
+	ledmatrix_select_panel(previous_panel);
+}
+
+// Move the viewport so that its bottom left corner is at (new_x, new_y),
+// stopping at the edges of the board
+static void move_origin(int16_t new_x, int16_t new_y)
+{
+	if (new_x < 0)
+	{
+		new_x = 0;
+	}
+	else if (new_x > max_x)
+	{
+		new_x = max_x;
+	}
+	if (new_y < 0)
+	{
+		new_y = 0;
+	}
+	else if (new_y > max_y)
+	{
+		new_y = max_y;
+	}
+	uint8_t steps_x = (new_x > origin_x) ? new_x - origin_x : origin_x - new_x;
+	uint8_t steps_y = (new_y > origin_y) ? new_y - origin_y : origin_y - new_y;
+	
+	uint8_t previous_panel = ledmatrix_selected_panel();
+	ledmatrix_select_panel(panel);
+	if (steps_x >= MATRIX_NUM_COLUMNS || steps_y >= MATRIX_NUM_ROWS
+			|| steps_x * PAN_COLUMN_COST + steps_y * PAN_ROW_COST
+			> REDRAW_COST)
+	{
+		origin_x = new_x;
+		origin_y = new_y;
+		redraw();
+	}
+	else
+	{
+		while (origin_x < new_x)
+		{
+			step_right();
+		}
+		while (origin_x > new_x)
+		{
+			step_left();
+		}
+		while (origin_y < new_y)
+		{
+			step_up();
+		}
+		while (origin_y > new_y)
+		{
+			step_down();
+		}
+	}
+	ledmatrix_select_panel(previous_panel);
+}
+
+void viewport_pan(int8_t dx, int8_t dy)
+{
+	move_origin(origin_x + dx, origin_y + dy);
+}
+
+void viewport_move_to(uint8_t x, uint8_t y)
+{
+	move_origin(x, y);
+}
+
+uint8_t viewport_x(void)
+{
+	return origin_x;
+}
+
+uint8_t viewport_y(void)
+{
+	return origin_y;
+}
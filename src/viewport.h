@@ -0,0 +1,48 @@
+/*
+ * viewport.h
+ *
+ * Shows part of a board which is larger than an LED matrix panel, and pans
+ * around it. The board itself isn't stored - the colour of each board cell
+ * is asked for (as a palette index) when it needs to be drawn.
+ *
+ * Panning uses the matrix's shift command: a one step pan shifts the panel
+ * and draws just the newly exposed column (12 SPI bytes) or row (20 bytes)
+ * rather than redrawing the whole panel (129 bytes). The matrix shifts the
+ * whole panel, so the viewport is always a whole panel (MATRIX_NUM_COLUMNS
+ * by MATRIX_NUM_ROWS) and nothing else should be drawn on that panel.
+ */
+
+#ifndef VIEWPORT_H_
+#define VIEWPORT_H_
+
+#include <stdint.h>
+#include "palette.h"
+
+// Returns the colour of the board cell at (x, y). y = 0 is the bottom row
+// of the board, as on the matrix.
+typedef PaletteIndex (*ViewportSource)(uint8_t x, uint8_t y);
+
+// Show the bottom left corner of a board of the given size on a panel.
+// Parts of the panel beyond the edges of a small board are black.
+void viewport_init(uint8_t panel_number, uint8_t board_width,
+		uint8_t board_height, ViewportSource source);
+
+// Redraw the whole viewport (e.g. after many board cells have changed)
+void viewport_draw(void);
+
+// Redraw one board cell if it is in view
+void viewport_draw_cell(uint8_t x, uint8_t y);
+
+// Move the viewport by dx columns and dy rows (positive is right and up),
+// stopping at the edges of the board. Short moves are made one shift at
+// a time, long ones by redrawing the viewport, whichever is cheaper.
+void viewport_pan(int8_t dx, int8_t dy);
+
+// Move the viewport so that its bottom left corner is at board cell (x, y)
+void viewport_move_to(uint8_t x, uint8_t y);
+
+// Board position of the bottom left corner of the viewport
+uint8_t viewport_x(void);
+uint8_t viewport_y(void);
+
+#endif /* VIEWPORT_H_ */